@@ -120,7 +120,13 @@ void run_inference_on_image(const std::string& imageFile, tflite::Interpreter* i
     model_profile.log_classification_model_stats(10.0, top_results);
 
     std::cout << "profiling samper" << std::endl;
-    image_sampler.sample(top_results, image, true);
+    // Sample on the full output distribution rather than the thresholded top-N
+    if (outputTensor->type == kTfLiteUInt8) {
+        image_sampler.sample(interpreter->typed_output_tensor<uint8_t>(0), outputShape[1],
+                             outputTensor->params.scale, outputTensor->params.zero_point, image, false, true);
+    } else {
+        image_sampler.sample(interpreter->typed_output_tensor<float>(0), outputShape[1], image, false, true);
+    }
 
     // Display image
     //cv::imshow("Output", frame);
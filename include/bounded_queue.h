@@ -0,0 +1,114 @@
+/**
+ * @file bounded_queue.h
+ * @brief Bounded lock-free multi-producer/multi-consumer queue.
+ */
+
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+/**
+ * @class BoundedQueue
+ * @brief Fixed-capacity ring buffer where producers and consumers never take a lock.
+ *
+ * Each cell carries a sequence number that tells producers whether the cell is
+ * free and consumers whether it holds data, so push() and pop() only contend on
+ * a single compare-and-swap of the enqueue or dequeue position.
+ * The capacity is rounded up to the next power of two.
+ */
+template<typename T>
+class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+    mask_ = size - 1;
+    buffer_.reset(new cell_t[size]);
+    for (size_t i = 0; i < size; ++i) {
+      buffer_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    enqueue_pos_.store(0, std::memory_order_relaxed);
+    dequeue_pos_.store(0, std::memory_order_relaxed);
+  }
+
+  BoundedQueue(const BoundedQueue&) = delete;
+  BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+  /**
+   * @brief Moves an item into the queue.
+   * @return false if the queue is full, in which case item is left untouched.
+   */
+  bool push(T&& item) {
+    cell_t *cell;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &buffer_[pos & mask_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->data = std::move(item);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Moves the oldest item out of the queue.
+   * @return false if the queue is empty.
+   */
+  bool pop(T& item) {
+    cell_t *cell;
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &buffer_[pos & mask_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    item = std::move(cell->data);
+    cell->data = T();
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Approximate emptiness check; exact when no push or pop is in flight.
+   */
+  bool empty() const {
+    return enqueue_pos_.load(std::memory_order_seq_cst) == dequeue_pos_.load(std::memory_order_seq_cst);
+  }
+
+  size_t capacity() const {
+    return mask_ + 1;
+  }
+
+private:
+  struct cell_t {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  std::unique_ptr<cell_t[]> buffer_;
+  size_t mask_;
+  alignas(64) std::atomic<size_t> enqueue_pos_;
+  alignas(64) std::atomic<size_t> dequeue_pos_;
+};
+
+#endif // BOUNDED_QUEUE_H
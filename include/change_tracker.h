@@ -0,0 +1,80 @@
+#ifndef CHANGE_TRACKER_H
+#define CHANGE_TRACKER_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+typedef struct {
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t hash;      // FNV-1a of the contents
+} file_version_t;
+
+typedef struct {
+    std::string path;
+    file_version_t version;
+} changed_file_t;
+
+/**
+ * @class ChangeTracker
+ * @brief Finds the files of a directory that are new or changed since they were last uploaded.
+ *
+ * Keeps an in-memory index of the version of every file reported and every
+ * file uploaded. A file whose inode, size and mtime match the index is not
+ * read; one that only had its mtime touched is hashed once and, if the
+ * contents match the uploaded version, not reported.
+ *
+ * On Linux the directory is watched with inotify, so after the first scan
+ * changed() only looks at files that were closed after writing or moved in;
+ * the directory is rescanned only if the event queue overflowed. Elsewhere,
+ * or when inotify is unavailable, every call rescans with stat() only.
+ * Dot files are ignored.
+ */
+class ChangeTracker {
+public:
+    /**
+     * @param path Directory to track, or a single file.
+     * @param useInotify Watch for changes instead of rescanning, where supported.
+     */
+    explicit ChangeTracker(const std::string& path, bool useInotify = true);
+    ~ChangeTracker();
+
+    ChangeTracker(const ChangeTracker&) = delete;
+    ChangeTracker& operator=(const ChangeTracker&) = delete;
+
+    /** @brief Files new or changed since the last call, each reported once per version. */
+    std::vector<changed_file_t> changed();
+
+    /** @brief Records that the reported version with this size and mtime was uploaded. */
+    void markUploaded(const std::string& path, uint64_t size, int64_t mtime_ns);
+
+    bool usingInotify() const { return inotify_fd_ >= 0; }
+    uint64_t getScans() const { return scans_.load(); }
+    uint64_t getFilesHashed() const { return hashed_.load(); }
+
+#ifndef TEST
+private:
+#endif
+    void scan(std::vector<changed_file_t>& out);
+    void check(const std::string& path, std::vector<changed_file_t>& out);
+    bool readEvents(std::vector<std::string>& paths);
+    bool tracked(const std::string& name) const;
+    void forget(const std::string& path);
+
+    std::string dir_;
+    std::string only_;      ///< Single file mode: the one name tracked in dir_
+    int inotify_fd_;
+    bool scanned_;
+    std::mutex mutex_;
+    std::map<std::string, file_version_t> uploaded_;
+    std::map<std::string, file_version_t> reported_;   ///< Reported, upload not confirmed yet
+    std::atomic<uint64_t> scans_;
+    std::atomic<uint64_t> hashed_;
+};
+
+#endif // CHANGE_TRACKER_H
@@ -230,6 +230,24 @@ class kll_sketch {
     template<typename FwdT>
     void update(FwdT&& item);
 
+    /**
+     * Updates this sketch with the given data item occurring the given number of times.
+     * This is equivalent to calling update(item) weight times, but costs at most one merge.
+     * @param item from a stream of items
+     * @param weight number of occurrences of the item
+     */
+    template<typename FwdT, typename std::enable_if<std::is_convertible<FwdT, T>::value, int>::type = 0>
+    void update(FwdT&& item, uint64_t weight);
+
+    /**
+     * Updates this sketch with a batch of data items.
+     * Items are copied straight into the free space of level zero, so compaction
+     * runs only when level zero fills up instead of being checked for every item.
+     * @param items pointer to the first item of the batch
+     * @param size number of items in the batch
+     */
+    void update(const T* items, size_t size);
+
     /**
      * Merges another sketch into this one.
      * @param other sketch to merge into this one
@@ -185,6 +185,64 @@ void kll_sketch<T, C, A>::update(FwdT&& item) {
   reset_sorted_view();
 }
 
+template<typename T, typename C, typename A>
+template<typename FwdT, typename std::enable_if<std::is_convertible<FwdT, T>::value, int>::type>
+void kll_sketch<T, C, A>::update(FwdT&& item, uint64_t weight) {
+  if (weight == 0 || !check_update_item(item)) { return; }
+  if (weight == 1) {
+    update(std::forward<FwdT>(item));
+    return;
+  }
+  if (weight <= levels_[0]) {
+    // small weights fit into the free space of level zero as plain copies
+    update_min_max(static_cast<const T&>(item));
+    for (uint64_t i = 0; i < weight; ++i) new (&items_[--levels_[0]]) T(item);
+    n_ += weight;
+    is_level_zero_sorted_ = false;
+    reset_sorted_view();
+    return;
+  }
+  // The weight is decomposed into powers of two: level i of a temporary sketch
+  // holds one copy of the item if bit i of the weight is set. Merging it keeps
+  // the total weight exact without pushing weight copies through level zero.
+  const uint8_t num_levels = 64 - count_leading_zeros_in_u64(weight);
+  uint32_t num_items = 0;
+  for (uint64_t w = weight; w != 0; w &= w - 1) ++num_items;
+  vector_u32 levels(num_levels + 1, 0, allocator_);
+  T* buffer = allocator_.allocate(num_items);
+  uint32_t index = 0;
+  for (uint8_t level = 0; level < num_levels; ++level) {
+    levels[level] = index;
+    if (weight & (static_cast<uint64_t>(1) << level)) new (&buffer[index++]) T(item);
+  }
+  levels[num_levels] = index;
+  std::unique_ptr<T, items_deleter> items(buffer, items_deleter(0, num_items, allocator_));
+  optional<T> min_item;
+  min_item.emplace(item);
+  optional<T> max_item;
+  max_item.emplace(item);
+  merge(kll_sketch(k_, min_k_, weight, num_levels, std::move(levels), std::move(items), num_items,
+      std::move(min_item), std::move(max_item), true, comparator_));
+}
+
+template<typename T, typename C, typename A>
+void kll_sketch<T, C, A>::update(const T* items, size_t size) {
+  size_t i = 0;
+  while (i < size) {
+    if (levels_[0] == 0) compress_while_updating();
+    is_level_zero_sorted_ = false;
+    // fill the free space of level zero without re-checking capacity per item
+    while (i < size && levels_[0] > 0) {
+      const T& item = items[i++];
+      if (!check_update_item(item)) continue;
+      update_min_max(item);
+      new (&items_[--levels_[0]]) T(item);
+      n_++;
+    }
+  }
+  reset_sorted_view();
+}
+
 template<typename T, typename C, typename A>
 void kll_sketch<T, C, A>::update_min_max(const T& item) {
   if (is_empty()) {
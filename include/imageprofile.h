@@ -11,17 +11,44 @@
 #include "iniparser.h" // Assuming declarations for IniReader, Saver, distributionBox
 #include "imghelpers.h"
 #include "saver.h"
+#include "samplewriter.h"
+#include "thread_pool.h"
+#include "sharded_sketch.h"
 #include <kll_sketch.hpp>
 #include "objectuploader.h"
 
 // Typedef for distribution box data structure (assuming datasketches::kll_sketch<float>)
 typedef datasketches::kll_sketch<float> distributionBox;
+typedef ShardedSketch<distributionBox> shardedDistributionBox;
+
+typedef enum {
+    IMAGE_METRIC_NOISE,
+    IMAGE_METRIC_BRIGHTNESS,
+    IMAGE_METRIC_SHARPNESS,
+    IMAGE_METRIC_CONTRAST,
+    IMAGE_METRIC_MEAN,
+    IMAGE_METRIC_HISTOGRAM,
+    IMAGE_METRIC_MAX
+} image_metric_e;
+
+/**
+ * @brief One configured image metric, resolved once at construction.
+ */
+typedef struct {
+    image_metric_e id;
+    std::string name;                             ///< INI key, reported as the sample reason
+    std::string file;                             ///< Sketch file name under filesSavePath
+    float threshold;                              ///< Parsed sampling threshold
+    shardedDistributionBox *box;                  ///< Sketch updated with the score
+    double (*score)(const image_stats_t &stats);  ///< Score from the fused statistics
+} image_metric_t;
 
 /**
  * @class ImageProfile
  * @brief A class for analyzing and storing image statistics.
  *
  * This class provides functionalities for analyzing image properties like distribution of pixel values, contrast, brightness, etc. It utilizes KLL sketches for memory-efficient storage of these statistics.
+ * The sketches are sharded per producer thread, so profile() and profileBatch() may be called from several threads at once.
  */
 class ImageProfile {
 public:
@@ -34,6 +61,7 @@ public:
    * @param channels The number of channels in the image (e.g., grayscale: 1, RGB: 3).
    * @param img_type The image type (implementation specific).
    * @param metrics The set of image metrics to be tracked (e.g., "contrast", "brightness").
+   * @throws std::invalid_argument if a configured metric threshold is not a number.
    */
   ImageProfile(std::string conf_path, int save_interval, int channels);
   ~ImageProfile();
@@ -52,41 +80,67 @@ public:
 
   int profile(cv::Mat &img, bool save_sample);
 
+  /**
+   * @brief Profiles a batch of images in one call.
+   *
+   * Statistics are computed per image, on the worker pool when the [image]
+   * section sets batch_threads > 1, then each sketch receives the whole batch
+   * in a single update. Pixel histograms are summed across the batch before
+   * they reach the sketches.
+   *
+   * @param imgs Images of the batch; they may differ in size.
+   * @param save_sample Flag indicating whether to save samples exceeding thresholds.
+   * @return 1 on success.
+   */
+  int profileBatch(const std::vector<cv::Mat> &imgs, bool save_sample = false);
+
   std::vector<std::pair<std::string, double>> samplingConfidences;
 
   void iterateImage(const cv::Mat& img, const std::function<void(const std::vector<int>&)>& callback);
 
   void updatePixelValues(const std::vector<int>& pixelValues);
 
+  /**
+   * @brief Feeds exact per-channel histograms into the pixel distribution boxes.
+   *
+   * Each non-empty bin is a single weighted sketch update, so the cost is
+   * bounded by 256 updates per channel regardless of the image size.
+   *
+   * @param histograms Per-channel histograms as produced by calculateChannelHistograms().
+   */
+  void updatePixelHistograms(const std::vector<channelHistogram>& histograms);
+
 #ifndef TEST
 private:
 #endif
 
     Saver *saver;
+    SampleWriter *sampleWriter;
+    ThreadPool *pool;   ///< Batch workers, null when batch_threads <= 1
     //ImageUploader *uploader;
 
   /**
    * @brief KLL sketch for storing contrast distribution.
    */
-  distributionBox contrastBox;
+  shardedDistributionBox contrastBox;
 
   /**
    * @brief KLL sketch for storing brightness distribution.
    */
-  distributionBox brightnessBox;
-  distributionBox sharpnessBox;
+  shardedDistributionBox brightnessBox;
+  shardedDistributionBox sharpnessBox;
 
-  std::vector<distributionBox> pixelBox;
+  std::vector<shardedDistributionBox *> pixelBox;
   /**
    * @brief KLL sketch for storing mean pixel value distribution.
    */
-  std::vector<distributionBox *> meanBox;
-  distributionBox entropyBox;
+  std::vector<shardedDistributionBox *> meanBox;
+  shardedDistributionBox entropyBox;
 
   /**
    * @brief KLL sketch for storing noise distribution.
    */
-  distributionBox noiseBox;
+  shardedDistributionBox noiseBox;
 
   // Per-channel KLL sketches (assuming pixelBox_r, etc. are for individual channels)
   /**
@@ -94,6 +148,18 @@ private:
    */
 	std::string filesSavePath;
 	std::map<std::string, std::string> imageConfig;
+
+  /**
+   * @brief Statistics computeImageStats() must produce for the configured metrics.
+   */
+  StatsMask statsMask;
+
+  /**
+   * @brief Configured metrics in the order profile() evaluates them.
+   */
+  std::vector<image_metric_t> metricPlan;
+
+  void compileMetricPlan(int channels);
 };
 
 #endif
@@ -13,6 +13,9 @@
 #include <vector>
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -21,20 +24,97 @@
 
 #include "iniparser.h"
 #include "saver.h"
+#include "samplewriter.h"
+#include "sharded_sketch.h"
 #include "objectuploader.h"
 
 // Typedef for distribution box data structure (assuming datasketches::kll_sketch<unit>)
 typedef datasketches::kll_sketch<float> distributionBox;
+typedef ShardedSketch<distributionBox> shardedDistributionBox;
+
+/**
+ * @brief Summary of a probability distribution shared by all confidence metrics.
+ */
+typedef struct {
+    float top1;     ///< Highest probability
+    float top2;     ///< Second highest probability
+    float entropy;  ///< -sum(p * log2(p)), unnormalised
+    size_t size;    ///< Number of classes
+} confidence_stats_t;
+
+/**
+ * @brief Computes the top-1/top-2 probabilities and entropy in one pass
+ *
+ * The input is neither sorted nor modified.
+ *
+ * @param prob_dist Class probabilities, in any order
+ * @param size Number of classes
+ * @param with_entropy Whether to accumulate the entropy sum
+ * @return The confidence statistics
+ */
+confidence_stats_t computeConfidenceStats(const float *prob_dist, size_t size, bool with_entropy);
+
+/**
+ * @brief Computes confidence statistics straight from a model output tensor
+ *
+ * Values are dequantized as scale * (q - zero_point). When apply_softmax is
+ * set the values are treated as logits and the statistics describe their
+ * softmax, computed without materialising the probabilities.
+ * Instantiated for float and uint8_t outputs.
+ *
+ * @param output Model output buffer
+ * @param size Number of classes
+ * @param scale Quantization scale (1 for float outputs)
+ * @param zero_point Quantization zero point (0 for float outputs)
+ * @param apply_softmax Whether the output holds logits
+ * @param with_entropy Whether to compute the entropy sum
+ * @return The confidence statistics
+ */
+template<typename T>
+confidence_stats_t computeTensorConfidenceStats(const T *output, size_t size, float scale, int zero_point,
+                                                bool apply_softmax, bool with_entropy);
+
+/** @brief Margin confidence, 1 - (top1 - top2) */
+float marginFromStats(const confidence_stats_t &stats);
+/** @brief Least confidence, (1 - top1) * n / (n - 1) */
+float leastFromStats(const confidence_stats_t &stats);
+/** @brief Ratio confidence, top2 / top1 */
+float ratioFromStats(const confidence_stats_t &stats);
+/** @brief Entropy normalised by log2(n) */
+float entropyFromStats(const confidence_stats_t &stats);
+
+typedef enum {
+    SAMPLING_METRIC_MARGIN,
+    SAMPLING_METRIC_LEAST,
+    SAMPLING_METRIC_RATIO,
+    SAMPLING_METRIC_ENTROPY,
+    SAMPLING_METRIC_MAX
+} sampling_metric_e;
+
+/**
+ * @brief One configured confidence metric, resolved once at construction.
+ */
+typedef struct {
+    sampling_metric_e id;
+    std::string name;       ///< INI key, reported as the sample reason
+    std::string file;       ///< Sketch file name under filesSavePath
+    float threshold;        ///< Parsed sampling threshold
+    shardedDistributionBox *box;   ///< Sketch updated with the score
+    float (*score)(const confidence_stats_t &stats);  ///< Score from the shared statistics
+} sampling_metric_t;
 
 /**
  * @class ImageSampler
  * @brief Class for selecting uncertain image samples for further analysis based on various confidence metrics
+ *
+ * The metric sketches are sharded per producer thread, so sample() and sampleBatch() may be called from several threads at once.
  */
 class ImageSampler {
 public:
   /**
    * @brief Constructor to initialize ImageSampler object with configuration file path
    * @param configFilePath Path to the configuration file
+   * @throws std::invalid_argument if a configured metric threshold is not a number
    */
   explicit ImageSampler(std::string conf_path, int save_interval);
   ~ImageSampler();
@@ -46,6 +126,73 @@ public:
    * @param saveSample Flag indicating whether to save sampled images
    */
    int sample(std::vector<std::pair<float, int>> &results, cv::Mat &img, bool save_sample);
+
+  /**
+   * @brief Selects uncertain image samples from a float model output buffer
+   *
+   * Metrics are computed directly on the buffer, over the full distribution, without copying it.
+   *
+   * @param output Model output tensor with one value per class
+   * @param size Number of classes
+   * @param img OpenCV image matrix
+   * @param apply_softmax Flag indicating the output holds logits rather than probabilities
+   * @param save_sample Flag indicating whether to save sampled images
+   * @return 1 on success
+   */
+   int sample(const float *output, size_t size, cv::Mat &img, bool apply_softmax = false, bool save_sample = true);
+
+  /**
+   * @brief Selects uncertain image samples from a quantized uint8 model output buffer
+   * @param output Model output tensor with one value per class
+   * @param size Number of classes
+   * @param scale Quantization scale of the output tensor
+   * @param zero_point Quantization zero point of the output tensor
+   * @param img OpenCV image matrix
+   * @param apply_softmax Flag indicating the output holds logits rather than probabilities
+   * @param save_sample Flag indicating whether to save sampled images
+   * @return 1 on success
+   */
+   int sample(const uint8_t *output, size_t size, float scale, int zero_point, cv::Mat &img,
+              bool apply_softmax = false, bool save_sample = true);
+
+  /**
+   * @brief Selects uncertain samples from a batch of classification results
+   *
+   * Each metric sketch receives the whole batch in one update.
+   *
+   * @param results Confidence scores, one vector per image
+   * @param imgs Images of the batch, in the same order as results
+   * @param save_sample Flag indicating whether to save sampled images
+   * @return 1 on success, -1 if results and imgs differ in size
+   */
+   int sampleBatch(std::vector<std::vector<std::pair<float, int>>> &results, std::vector<cv::Mat> &imgs,
+                   bool save_sample = true);
+
+  /**
+   * @brief Selects uncertain samples from a batched float model output buffer
+   * @param output Model output tensor laid out as [batch][size]
+   * @param size Number of classes
+   * @param imgs Images of the batch; imgs.size() is the batch size
+   * @param apply_softmax Flag indicating the output holds logits rather than probabilities
+   * @param save_sample Flag indicating whether to save sampled images
+   * @return 1 on success
+   */
+   int sampleBatch(const float *output, size_t size, std::vector<cv::Mat> &imgs,
+                   bool apply_softmax = false, bool save_sample = true);
+
+  /**
+   * @brief Selects uncertain samples from a batched quantized uint8 model output buffer
+   * @param output Model output tensor laid out as [batch][size]
+   * @param size Number of classes
+   * @param scale Quantization scale of the output tensor
+   * @param zero_point Quantization zero point of the output tensor
+   * @param imgs Images of the batch; imgs.size() is the batch size
+   * @param apply_softmax Flag indicating the output holds logits rather than probabilities
+   * @param save_sample Flag indicating whether to save sampled images
+   * @return 1 on success
+   */
+   int sampleBatch(const uint8_t *output, size_t size, float scale, int zero_point, std::vector<cv::Mat> &imgs,
+                   bool apply_softmax = false, bool save_sample = true);
   
    /**
    * @brief Calculates margin confidence (difference between top two probabilities)
@@ -53,7 +200,7 @@ public:
    * @param sorted Flag indicating if probabilities are already sorted (default: false)
    * @return Margin confidence score
    */
-   float margin_confidence(std::vector<float>& prob_dist, bool sorted);
+   float margin_confidence(const std::vector<float>& prob_dist, bool sorted);
 
   /**
    * @brief Calculates least confidence (normalized maximum probability)
@@ -61,7 +208,7 @@ public:
    * @param sorted Flag indicating if probabilities are already sorted (default: false)
    * @return Least confidence score
    */
-    float least_confidence(std::vector<float>& prob_dist, bool sorted);
+    float least_confidence(const std::vector<float>& prob_dist, bool sorted);
 
   /**
    * @brief Calculates ratio confidence (ratio of top two probabilities)
@@ -69,24 +216,35 @@ public:
    * @param sorted Flag indicating if probabilities are already sorted (default: false)
    * @return Ratio confidence score
    */
-    float ratio_confidence(std::vector<float>& prob_dist, bool sorted);
+    float ratio_confidence(const std::vector<float>& prob_dist, bool sorted);
 
   /**
    * @brief Calculates entropy-based confidence
    * @param probabilityDistribution Vector of class probabilities
    * @return Entropy-based confidence score
    */
-   float entropy_confidence(std::vector<float>& prob_dist);
+   float entropy_confidence(const std::vector<float>& prob_dist);
    std::string filesSavePath;
 private:   
   // Member variables for storing confidence metric statistics
-  distributionBox marginConfidenceBox;
-  distributionBox leastConfidenceBox;
-  distributionBox ratioConfidenceBox;
-  distributionBox entropyConfidenceBox;
+  shardedDistributionBox marginConfidenceBox;
+  shardedDistributionBox leastConfidenceBox;
+  shardedDistributionBox ratioConfidenceBox;
+  shardedDistributionBox entropyConfidenceBox;
     Saver *saver;
+    SampleWriter *sampleWriter;
     //ImageUploader *uploader;
 	std::map<std::string, std::string> samplingConfig;
+
+  /**
+   * @brief Configured metrics in the order sample() evaluates them.
+   */
+  std::vector<sampling_metric_t> metricPlan;
+  bool needEntropy;                 ///< Whether any configured metric uses the entropy
+
+  void compileMetricPlan();
+  int sampleStats(const confidence_stats_t &stats, cv::Mat &img, bool save_sample);
+  int sampleBatchStats(const std::vector<confidence_stats_t> &stats, std::vector<cv::Mat> &imgs, bool save_sample);
 };
 
 #endif // CONFIDENCE_METRICS_H
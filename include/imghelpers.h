@@ -2,9 +2,74 @@
 #define IMGHELPERS_H
 
 #include <opencv2/opencv.hpp>
+#include <array>
+#include <cstdint>
 #include <vector>
 #include <string>
 
+/**
+ * @brief Exact 256-bin histogram of one 8-bit image channel.
+ */
+typedef std::array<uint32_t, 256> channelHistogram;
+
+/**
+ * @brief Selects which statistics computeImageStats() fills in.
+ */
+typedef enum {
+    STATS_MEAN_STDDEV   = 1 << 0,  ///< Grayscale mean and standard deviation
+    STATS_MIN_MAX       = 1 << 1,  ///< Grayscale minimum and maximum
+    STATS_CHANNEL_MEANS = 1 << 2,  ///< Per-channel means of the input image
+    STATS_LAPLACIAN     = 1 << 3,  ///< Variance of the grayscale Laplacian
+    STATS_ALL           = 0xF
+} image_stats_mask_e;
+
+typedef unsigned int StatsMask;
+
+/**
+ * @brief Image statistics computed in a single fused scan.
+ *
+ * Only the fields selected by the StatsMask passed to computeImageStats()
+ * are valid; the others are left at zero.
+ */
+typedef struct {
+    double mean;                ///< Grayscale mean
+    double stddev;              ///< Grayscale standard deviation
+    double min;                 ///< Grayscale minimum
+    double max;                 ///< Grayscale maximum
+    double laplacianVariance;   ///< Variance of the grayscale Laplacian
+    cv::Scalar channelMeans;    ///< Mean of each input channel
+    int channels;               ///< Number of channels of the input image
+} image_stats_t;
+
+/**
+ * @brief Compute the selected image statistics with one grayscale conversion.
+ *
+ * For 8-bit images the grayscale mean, standard deviation, min/max and
+ * Laplacian variance are all accumulated in one pass over the grayscale
+ * rows. The results match calculateSNR(), calculateContrast(),
+ * calculateSharpnessLaplacian() and calculateBrightness().
+ *
+ * @param img The input image.
+ * @param mask Bitwise OR of image_stats_mask_e values.
+ * @return image_stats_t The computed statistics.
+ */
+image_stats_t computeImageStats(const cv::Mat &img, StatsMask mask);
+
+/**
+ * @brief Derive the Signal-to-Noise Ratio from STATS_MEAN_STDDEV statistics.
+ */
+double statsSNR(const image_stats_t &stats);
+
+/**
+ * @brief Derive the contrast from STATS_MIN_MAX statistics.
+ */
+double statsContrast(const image_stats_t &stats);
+
+/**
+ * @brief Derive the brightness from STATS_CHANNEL_MEANS statistics.
+ */
+double statsBrightness(const image_stats_t &stats);
+
 /**
  * @brief Convert an image to grayscale.
  * 
@@ -62,6 +127,19 @@ double calculateContrast(cv::Mat &img);
  */
 double calculateBrightness(cv::Mat &img);
 
+/**
+ * @brief Calculate exact per-channel histograms of an 8-bit image.
+ *
+ * Walks the image row by row through raw pointers and counts every channel
+ * value into its 256-bin histogram, without per-pixel allocations.
+ *
+ * @param img The input image (CV_8U depth, 1 to 4 channels).
+ * @param histograms Output, resized to img.channels() and overwritten.
+ * @return int 0 on success.
+ * @throws std::runtime_error if the image is empty or not supported.
+ */
+int calculateChannelHistograms(const cv::Mat &img, std::vector<channelHistogram> &histograms);
+
 /**
  * @brief Save an image with an incremental name in the specified directory.
  * 
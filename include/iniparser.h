@@ -5,6 +5,7 @@
 #include <fstream>
 #include <string>
 #include <map>
+#include <stdexcept>
 
 /**
  * @brief Class for parsing INI files and extracting key-value pairs.
@@ -20,6 +21,16 @@ public:
      * @return A map containing the key-value pairs.
      */
     static std::map<std::string, std::string> parseIniFile(const std::string& filename, const std::string& section, const std::string& key);
+
+    /**
+     * @brief Parses a metric threshold value.
+     * 
+     * @param key The metric name, used in the error message.
+     * @param value The value read from the INI file.
+     * @return The threshold.
+     * @throws std::invalid_argument if the value is not a number.
+     */
+    static float parseThreshold(const std::string& key, const std::string& value);
 };
 
 #endif // INIPARSER_H
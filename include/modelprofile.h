@@ -9,7 +9,9 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <shared_mutex>
 #include "saver.h"
+#include "sharded_sketch.h"
 #include <kll_sketch.hpp>
 #include <frequent_items_sketch.hpp>
 #include "objectuploader.h"
@@ -22,7 +24,14 @@
 typedef datasketches::kll_sketch<float> distributionBox;
 typedef std::vector<std::pair<float, int>> ClassificationResults;
 typedef datasketches::frequent_items_sketch<std::string> frequent_class_sketch;
+typedef ShardedSketch<distributionBox> shardedDistributionBox;
 
+/**
+ * @brief Class for managing and logging model statistics
+ *
+ * Sketches are sharded per producer thread, so the logging methods may be
+ * called from several threads at once.
+ */
 class ModelProfile {
 public:
   /**
@@ -43,6 +52,19 @@ public:
    */
   int log_classification_model_stats(float inference_latency, const ClassificationResults& results);
 
+  /**
+   * @brief Logs statistics for a batch of classification results
+   *
+   * Scores are grouped by class first, so each class sketch receives one
+   * batched update and the frequent class sketch one weighted update per
+   * class, however many images the batch holds.
+   *
+   * @param inference_latency Time taken for inference of the whole batch
+   * @param batch Classification results, one entry per image
+   * @return 0 on success, negative value on error
+   */
+  int log_classification_model_stats_batch(float inference_latency, const std::vector<ClassificationResults>& batch);
+
   /**
    * @brief Logs statistics for a YOLOv5 model
    * @param inference_latency Time taken for model inference
@@ -51,7 +73,7 @@ public:
    */
   //int log_yolov5_model_stats(float inference_latency, const YoloDetections& results);
 
-  frequent_class_sketch *sketch1;
+  ShardedSketch<frequent_class_sketch> *sketch1;
   int getNumDistributionBoxes() const;
   const distributionBox& getDistributionBox(unsigned int index) const;
 
@@ -69,8 +91,10 @@ public:
   std::vector<float> inference_latency_;
   std::vector<int> no_detections_per_image_;
   std::vector<double> objectnessbox_;
-  distributionBox *dBox;
-  std::map<int, distributionBox*> model_classes_stat_;
+  std::map<int, shardedDistributionBox*> model_classes_stat_;
+  std::shared_timed_mutex classes_mutex_;  // Guards model_classes_stat_; exclusive only to add a class
+
+  shardedDistributionBox *classBox(int cls);
 };
 
 #endif // MODEL_STATS_H
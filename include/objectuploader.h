@@ -13,6 +13,7 @@
 #endif
 
 #include <chrono>
+#include <condition_variable>
 #include <mutex>
 #include <atomic>
 
@@ -62,6 +63,8 @@ private:
     s3_client_config_t s3_client_config_;
   std::atomic<bool> stopFlag_;             ///< Flag to indicate stopping the upload thread
   std::mutex uploadMutex_;                 ///< Mutex for thread-safe image upload
+  std::mutex stopMutex_;                   ///< Guards stopFlag_ for stopCv_, never held during uploads
+  std::condition_variable stopCv_;         ///< Wakes the upload thread from its interval wait on stop
     HttpUploader * _HttpUploader;
   // Function to run the upload thread (implementation in ImageUploader.cpp)
   void uploadThread(const std::string& imagePath, const std::string& bucketName,
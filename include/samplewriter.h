@@ -0,0 +1,140 @@
+/**
+ * @file samplewriter.h
+ * @brief Background writer for sample images selected by the profilers.
+ */
+
+#ifndef SAMPLE_WRITER_H
+#define SAMPLE_WRITER_H
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+
+typedef enum {
+    SAMPLE_CODEC_PNG,
+    SAMPLE_CODEC_JPEG,
+    SAMPLE_CODEC_RAW,
+    SAMPLE_CODEC_MAX
+} sample_codec_e;
+
+typedef enum {
+    SAMPLE_DROP_NEWEST,   ///< Reject the incoming sample when the queue is full
+    SAMPLE_DROP_OLDEST,   ///< Discard the oldest queued sample to make room
+    SAMPLE_DROP_MAX
+} sample_drop_policy_e;
+
+/**
+ * @brief One metric that selected a frame as a sample.
+ */
+typedef struct {
+    std::string metric;
+    float score;
+    float threshold;
+} sample_reason_t;
+
+typedef struct {
+    size_t queue_size;
+    sample_codec_e codec;
+    sample_drop_policy_e drop_policy;
+    int jpeg_quality;
+} sample_writer_config_t;
+
+/**
+ * @brief Reads the optional sample writer keys of a profiler INI section.
+ *
+ * Recognised keys are sample_codec (png, jpeg, raw), sample_queue_size,
+ * sample_drop_policy (newest, oldest) and sample_jpeg_quality. They are
+ * removed from the map so metric loops do not see them.
+ *
+ * @param config Key-value pairs of the INI section.
+ * @return sample_writer_config_t The parsed configuration, defaults for missing keys.
+ */
+sample_writer_config_t parseSampleWriterConfig(std::map<std::string, std::string> &config);
+
+/**
+ * @class SampleWriter
+ * @brief Encodes and writes sample images on a background thread.
+ *
+ * enqueue() only copies the image into a bounded lock-free queue, so the
+ * caller's inference loop never waits for encoding or disk I/O. File indices
+ * are tracked in memory per folder and base name; the folder is scanned once,
+ * the first time a base name is written, to continue after existing files.
+ */
+class SampleWriter {
+public:
+  explicit SampleWriter(const sample_writer_config_t &config);
+  ~SampleWriter();
+
+  /**
+   * @brief Queues an image to be written as <path>/<baseName><index>.<ext>.
+   * @param img Image to save; it is copied, so the caller may reuse its buffer.
+   * @param path Destination folder.
+   * @param baseName Base name of the file.
+   * @return true if queued, false if dropped because the queue is full.
+   */
+  bool enqueue(const cv::Mat &img, const std::string &path, const std::string &baseName);
+
+  /**
+   * @brief Queues one image selected by one or more metrics on the same frame.
+   *
+   * The image is encoded and written once, named after the first reason, and a
+   * line listing every reason is appended to <path>/manifest.csv:
+   * file,unix_time,metric=score/threshold;metric=score/threshold...
+   *
+   * @param img Image to save; it is copied, so the caller may reuse its buffer.
+   * @param path Destination folder.
+   * @param reasons Metrics that crossed their thresholds; nothing is queued if empty.
+   * @return true if queued, false if dropped or there is no reason.
+   */
+  bool enqueue(const cv::Mat &img, const std::string &path, const std::vector<sample_reason_t> &reasons);
+
+  /**
+   * @brief Writes every queued sample and stops the writer thread.
+   */
+  void stop();
+
+  uint64_t getWrittenCount() const { return written_.load(); }
+  uint64_t getDroppedCount() const { return dropped_.load(); }
+  // Samples dequeued but not written: directory, encoder or file errors
+  uint64_t getFailedCount() const { return failed_.load(); }
+
+#ifndef TEST
+private:
+#endif
+  typedef struct {
+    cv::Mat img;
+    std::string path;
+    std::string baseName;
+    std::vector<sample_reason_t> reasons;
+    time_t timestamp;
+  } sample_item_t;
+
+  bool push(sample_item_t &item);
+  void appendManifest(const sample_item_t &item, const std::string &filename);
+
+  void writeLoop();
+  void writeSample(sample_item_t &item);
+  int nextIndex(const std::string &path, const std::string &baseName);
+  void wakeWriter();
+
+  sample_writer_config_t config_;
+  BoundedQueue<sample_item_t> queue_;
+  std::map<std::string, int> indices_;   // Owned by the writer thread
+  std::atomic<bool> exit_;
+  std::atomic<bool> sleeping_;
+  std::atomic<uint64_t> written_;
+  std::atomic<uint64_t> dropped_;
+  std::atomic<uint64_t> failed_;
+  std::mutex wait_mutex_;
+  std::condition_variable cv_;
+  std::thread write_thread_;
+};
+
+#endif // SAMPLE_WRITER_H
@@ -0,0 +1,100 @@
+/**
+ * @file save_scheduler.h
+ * @brief Process-wide scheduler running the save cycles of every Saver.
+ */
+
+#ifndef SAVE_SCHEDULER_H
+#define SAVE_SCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+class Saver;
+class ThreadPool;
+
+/**
+ * @class SaveScheduler
+ * @brief One save thread shared by all profilers of the process.
+ *
+ * Deadlines are aligned to multiples of each saver's interval on the steady
+ * clock, so savers with the same interval come due together instead of
+ * waking independently. Savers that come due together write their files one
+ * after another on the scheduler thread, or spread over a small worker pool
+ * when setWorkers() is above 1. The files of the whole batch are then synced,
+ * renamed and their directories fsynced in a single pass, so a dozen
+ * profilers cost one directory fsync per interval rather than a dozen.
+ * Pending files are closed between the two steps and synced one at a time,
+ * so a batch may hold more files than the descriptor limit allows.
+ */
+class SaveScheduler {
+public:
+  /**
+   * @brief The process-wide scheduler; its thread starts with the first registered saver.
+   */
+  static SaveScheduler &instance();
+
+  SaveScheduler(const SaveScheduler&) = delete;
+  SaveScheduler& operator=(const SaveScheduler&) = delete;
+
+  /**
+   * @brief Registers a saver; its first cycle runs as soon as it has objects.
+   */
+  void add(Saver *saver);
+
+  /**
+   * @brief Unregisters a saver, waiting for a cycle of it that is already running.
+   */
+  void remove(Saver *saver);
+
+  /**
+   * @brief Runs a cycle of the saver now instead of at its next deadline.
+   */
+  void trigger(Saver *saver);
+
+  /**
+   * @brief Global flush barrier: runs a cycle of every registered saver and waits for all of them.
+   *
+   * Updates made before the call are on disk when it returns (subject to each
+   * saver's sync policy). Must not be called from a save cycle.
+   */
+  void flush();
+
+  /**
+   * @brief Number of threads writing the savers that come due together; 1 writes them on the scheduler thread.
+   */
+  void setWorkers(size_t workers);
+
+  size_t registered();
+
+#ifndef TEST
+private:
+#endif
+  SaveScheduler();
+  ~SaveScheduler();
+
+  typedef struct {
+    Saver *saver;
+    std::chrono::steady_clock::time_point deadline;
+    bool requested;      // Run before the deadline: trigger(), flush() or first objects
+    bool running;
+    uint64_t completed;  // Finished cycles, for flush()
+  } schedule_entry_t;
+
+  void ScheduleLoop();
+  std::list<schedule_entry_t>::iterator Find(Saver *saver);
+
+  std::mutex mutex_;
+  std::condition_variable wake_cv_;   // New work or an earlier deadline
+  std::condition_variable done_cv_;   // A batch of cycles finished
+  std::list<schedule_entry_t> entries_;  // Stable iterators while a batch runs unlocked
+  std::thread thread_;
+  bool stop_;
+  std::shared_ptr<ThreadPool> pool_;  // Held by a running batch, so setWorkers() can swap it
+};
+
+#endif // SAVE_SCHEDULER_H
@@ -7,53 +7,234 @@
 #include <queue>
 #include <string>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "serializable.h"
+#include "save_scheduler.h"
 
-//#include "MyObject.h" // Include your object header
 typedef struct {
     std::string filename;
 	int type;
-	void *obj;
+	ISerializable *obj;         // Owned by the saver
+	uint64_t saved_generation;  // Generation last written, owned by the save thread
+	// Log mode state, owned by the save thread
+	std::string segment;        // Current segment file
+	time_t segment_start;
+	uint64_t segment_bytes;
+	time_t window_start;        // Start of the delta not yet logged
+	std::vector<uint8_t> cached;  // Container mode: bytes of the last snapshot
 }data_object_t;
 
 typedef enum {
     KLL_TYPE,
     FI_TYPE,
-    TYPE_MAX
+    SHARDED_KLL_TYPE,   ///< ShardedSketch<kll_sketch<float>>, shards merged on save
+    SHARDED_FI_TYPE,    ///< ShardedSketch<frequent_items_sketch<std::string>>, shards merged on save
+    TYPE_MAX            ///< Any other ISerializable
 }data_object_type_e;
 
+/**
+ * @brief data_object_type_e recorded for a sketch type, e.g. in the container index.
+ */
+template<typename SketchT>
+int sketchTypeId(const SketchT *) { return TYPE_MAX; }
+inline int sketchTypeId(const datasketches::kll_sketch<float> *) { return KLL_TYPE; }
+inline int sketchTypeId(const datasketches::frequent_items_sketch<std::string> *) { return FI_TYPE; }
+inline int sketchTypeId(const ShardedSketch<datasketches::kll_sketch<float>> *) { return SHARDED_KLL_TYPE; }
+inline int sketchTypeId(const ShardedSketch<datasketches::frequent_items_sketch<std::string>> *) { return SHARDED_FI_TYPE; }
+
+typedef enum {
+    SAVER_SYNC_NONE,    ///< Atomic rename only; survives a process crash, not a power loss
+    SAVER_SYNC_CYCLE,   ///< Write every file of the cycle, then fdatasync each before the renames
+    SAVER_SYNC_FILE,    ///< fdatasync every file before its rename
+    SAVER_SYNC_MAX
+} saver_sync_policy_e;
+
+typedef enum {
+    SAVER_MODE_SNAPSHOT,   ///< Overwrite <file> with the cumulative sketch each cycle
+    SAVER_MODE_LOG,        ///< Append the delta since the last cycle to <file>.<start>.log segments
+    SAVER_MODE_CONTAINER,  ///< Write every object into one container file per cycle
+    SAVER_MODE_MAX
+} saver_mode_e;
+
+typedef struct {
+    saver_sync_policy_e sync_policy;
+    saver_mode_e mode;
+    uint64_t segment_bytes;    ///< Log mode: start a new segment past this size
+    int64_t segment_seconds;   ///< Log mode: start a new segment past this age
+    std::string container_path;  ///< Container mode: output file, <dir>/<class name>.dtc if empty
+    int64_t interval_ms;       ///< Overrides the constructor interval when positive
+} saver_config_t;
+
+/**
+ * @brief Default configuration: snapshot mode, files synced together at the end of each cycle, hourly 4 MiB segments.
+ */
+saver_config_t defaultSaverConfig();
+
+/**
+ * @brief Reads the optional saver keys of a profiler INI section.
+ *
+ * Recognised keys are save_sync (none, cycle, file), save_mode (snapshot,
+ * log, container), save_container, save_interval_ms, log_segment_bytes and log_segment_seconds.
+ * They are removed from the map so metric loops do not see them.
+ *
+ * @param config Key-value pairs of the INI section.
+ * @return saver_config_t The parsed configuration, defaults for missing keys.
+ */
+saver_config_t parseSaverConfig(std::map<std::string, std::string> &config);
+
+/**
+ * @brief Reads a file written by Saver and verifies its checksum footer.
+ * @param filename File to read.
+ * @param payload Receives the serialized object without the footer.
+ * @return true if the file exists and its checksum matches.
+ */
+bool readSavedObject(const std::string &filename, std::vector<uint8_t> &payload);
+
+/**
+ * @brief One delta sketch of a log mode object.
+ */
+typedef struct {
+    time_t start;                  ///< Window start, unix seconds
+    time_t end;                    ///< Window end, unix seconds
+    std::vector<uint8_t> payload;  ///< Serialized delta sketch
+} sketch_log_record_t;
+
+/**
+ * @brief Reads the log records of an object whose window overlaps [from, to].
+ *
+ * Segments are <filename>.<start>.log next to filename. A torn or corrupt
+ * record ends its segment, so a crash mid-append only loses that record.
+ *
+ * @param filename File name the object was registered with.
+ * @param from Range start, unix seconds.
+ * @param to Range end, unix seconds.
+ * @param records Receives the matching records, oldest first.
+ * @return Number of records read.
+ */
+size_t readSketchLog(const std::string &filename, time_t from, time_t to,
+                     std::vector<sketch_log_record_t> &records);
+
+/**
+ * @brief Merges the logged deltas of an object over a time range.
+ * @param filename File name the object was registered with.
+ * @param from Range start, unix seconds.
+ * @param to Range end, unix seconds.
+ * @param merged Empty sketch the deltas are merged into.
+ * @return The merged sketch.
+ */
+template<typename SketchT>
+SketchT mergeSketchLog(const std::string &filename, time_t from, time_t to, SketchT merged) {
+    std::vector<sketch_log_record_t> records;
+    readSketchLog(filename, from, to, records);
+    for (const auto &record : records) {
+        merged.merge(SketchT::deserialize(record.payload.data(), record.payload.size()));
+    }
+    return merged;
+}
+
 class Saver {
 public:
-  // Constructor to specify filename and save interval
+  // Constructor to specify filename and save interval in seconds
   Saver(int interval, std::string class_name);
+  Saver(int interval, std::string class_name, const saver_config_t &config);
+  // Sub-second intervals; config.interval_ms still takes precedence when set
+  Saver(std::chrono::milliseconds interval, std::string class_name, const saver_config_t &config);
   ~Saver();
 
-  // Add an object to the queue for saving
+  // Add a sketch to the queue for saving; any type SketchSerializable can adapt
+  template<typename SketchT>
+  void AddObjectToSave(SketchT *object, const std::string& filename) {
+    AddSerializable(new SketchSerializable<SketchT>(object), sketchTypeId(object), filename);
+  }
+
+  // Add an object with its own serialization; the saver takes ownership.
+  // In container mode an object whose file base name is already taken is deleted and skipped.
+  void AddSerializable(ISerializable *object, int type, const std::string& filename);
+
+  // Untyped form kept for existing callers; type is a data_object_type_e below TYPE_MAX
   void AddObjectToSave(void *object, int type, const std::string& filename);
 
-  // Start the background thread to save objects from the queue periodically
+  // Register with the process-wide SaveScheduler to save objects from the queue periodically
   void StartSaving();
 
-  // Manual trigger to save all objects in the queue immediately
+  // Manual trigger to save all objects in the queue immediately; wakes the scheduler
   void TriggerSave();
 
+  // Unregisters from the scheduler once a running cycle of this saver has finished
   void StopSaving();
 
+  bool IsSaving() const { return saving_.load(); }
+  std::chrono::milliseconds GetInterval() const { return save_interval_; }
+
+  // Bytes written by the most recent save cycle, footers included
+  uint64_t GetLastCycleBytes() const { return last_cycle_bytes_.load(); }
+  // Bytes written since the saver was created
+  uint64_t GetTotalBytesWritten() const { return total_bytes_.load(); }
+  // Objects skipped because they had no update since they were last written
+  uint64_t GetSkippedCount() const { return skipped_.load(); }
+
 #ifndef TEST
 private:
 #endif
-  // Function to be executed in the background thread
+  friend class SaveScheduler;
   std::string parent_name;
-  void SaveLoop();
 
-  std::atomic<bool> exitSaveLoop;
+  std::atomic<bool> saving_;       // Registered with the scheduler
   std::queue<data_object_t *> objects_to_save_;  // Queue of objects to be saved
-  int save_interval_;     // Interval between saves in minutes
-  std::thread save_thread_;        // Thread object for saving
+  std::chrono::milliseconds save_interval_;     // Interval between two save cycles
   std::mutex queue_mutex_;         // Mutex for queue access
-  std::condition_variable cv_;     // Condition variable for thread synchronization
+  std::set<std::string> container_names_;  // Container mode: entry names taken, guarded by queue_mutex_
+
+  typedef struct {
+    Saver *saver;            // Owner, for its sync policy and byte counters
+    // Objects whose saved_generation is set once the write is committed; every object for the container
+    std::vector<std::pair<data_object_t *, uint64_t>> objects;
+    std::string filename;    // Final path
+    std::string tmpname;     // Empty for log records, appended in place
+    size_t bytes;
+    bool sync;               // CommitWrites reopens and fdatasyncs it (SAVER_SYNC_CYCLE)
+  } pending_write_t;
+
+  // One save cycle, run by the scheduler; never concurrently for the same saver.
+  // Files are written but not yet synced or renamed; that is left to CommitWrites.
+  void RunCycle(std::vector<pending_write_t> &pending);
+  // Syncs and renames the writes of any number of savers in one pass, then fsyncs their directories once
+  static size_t CommitWrites(std::vector<pending_write_t> &pending);
+
+  saver_config_t config_;
+  std::atomic<uint64_t> last_cycle_bytes_;
+  std::atomic<uint64_t> total_bytes_;
+  std::atomic<uint64_t> skipped_;
+
+  typedef struct {
+    data_object_t *object;
+    uint64_t generation;
+    bool log;                // Drained delta, written as a log record
+    size_t offset;           // Slice of arena_ holding the file or record bytes
+    size_t size;
+  } cycle_item_t;
+
+  // Serialization buffer of a cycle, reused so steady-state cycles do not reallocate it;
+  // the sketch copies made by prepare() are still allocated, and released, every cycle
+  std::vector<uint8_t> arena_;
+  std::vector<cycle_item_t> items_;
 
-  // Replace this function with your actual logic to save the object to a file
-  void SaveObjectToFile(data_object_t *object);
+  // One save cycle in snapshot/log mode and in container mode
+  void SaveFiles(std::queue<data_object_t *> &cycle, std::vector<pending_write_t> &pending);
+  void SaveContainer(std::queue<data_object_t *> &cycle, std::vector<pending_write_t> &pending);
+  // Writes bytes to <filename>.tmp
+  bool WriteTempFile(const std::string &filename, const uint8_t *bytes, size_t size, pending_write_t &pending);
+  // Log mode: appends an encoded record to the object's current segment
+  bool AppendLogRecord(data_object_t *object, const uint8_t *record, size_t size, time_t now,
+                       pending_write_t &pending);
+  // Closes fd, first starting write-back and marking the file for CommitWrites when the policy syncs per cycle
+  void closeForSync(int fd, pending_write_t &pending);
 };
 
 #endif // SAVER_H
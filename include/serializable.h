@@ -0,0 +1,191 @@
+/**
+ * @file serializable.h
+ * @brief Typed serialization interface used by Saver to write sketches into caller-owned buffers.
+ */
+
+#ifndef SERIALIZABLE_H
+#define SERIALIZABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <streambuf>
+#include <kll_sketch.hpp>
+#include <frequent_items_sketch.hpp>
+
+#include "sharded_sketch.h"
+
+/**
+ * @class ISerializable
+ * @brief An object Saver can write without knowing its type.
+ *
+ * Saver calls prepare() once per cycle, then serialized_size() to reserve
+ * space and serialize_into() to fill it, so every object of a cycle lands in
+ * one preallocated buffer. Both operate on the state frozen by prepare(), so
+ * concurrent updates cannot make the written size differ from the reserved one.
+ * The frozen state is a full copy (or merge) of the object; release() frees it
+ * once the bytes are written, so it only exists during a cycle.
+ */
+class ISerializable {
+public:
+  /** Generation meaning "no cheap update counter": the object is written every cycle. */
+  static const uint64_t kAlwaysDirty = UINT64_MAX;
+
+  virtual ~ISerializable() {}
+
+  /**
+   * @brief Update counter; an unchanged value means the last written copy is current.
+   */
+  virtual uint64_t generation() const = 0;
+
+  /**
+   * @brief Whether prepare(true) can take the delta since the previous drain (log mode).
+   */
+  virtual bool supports_drain() const = 0;
+
+  /**
+   * @brief Freezes the state the next serialize_into() writes.
+   * @param drain Take and reset the delta since the previous drain instead of a cumulative copy.
+   * @return false if there is nothing to write (an empty delta).
+   */
+  virtual bool prepare(bool drain) = 0;
+
+  /**
+   * @brief Exact size serialize_into() writes for the prepared state.
+   */
+  virtual size_t serialized_size() const = 0;
+
+  /**
+   * @brief Serializes the prepared state.
+   * @param dst Destination, at least serialized_size() bytes.
+   * @param capacity Size of dst.
+   * @return Bytes written, 0 if the state did not fit.
+   */
+  virtual size_t serialize_into(uint8_t *dst, size_t capacity) const = 0;
+
+  /**
+   * @brief Ends the cycle started by prepare() and frees the frozen state.
+   * @param written Whether the prepared state reached its file; a drained delta
+   *        that did not is kept and folded into the next prepare(true).
+   */
+  virtual void release(bool written) { (void)written; }
+};
+
+/**
+ * @brief std::streambuf writing into a fixed buffer, so stream-only serializers need no temporary vector.
+ */
+class spanbuf : public std::streambuf {
+public:
+  spanbuf(uint8_t *dst, size_t capacity) {
+    char *begin = reinterpret_cast<char *>(dst);
+    setp(begin, begin + capacity);
+  }
+  size_t written() const { return static_cast<size_t>(pptr() - pbase()); }
+};
+
+/**
+ * @brief Update counter of a plain sketch, overloaded for sketch types that have one.
+ *
+ * Types without an overload report kAlwaysDirty and are rewritten every cycle.
+ */
+template<typename SketchT>
+uint64_t sketchGeneration(const SketchT &) {
+  return ISerializable::kAlwaysDirty;
+}
+
+template<typename T, typename C, typename A>
+uint64_t sketchGeneration(const datasketches::kll_sketch<T, C, A> &sketch) {
+  return sketch.get_n();
+}
+
+template<typename T, typename W, typename H, typename E, typename A>
+uint64_t sketchGeneration(const datasketches::frequent_items_sketch<T, W, H, E, A> &sketch) {
+  return static_cast<uint64_t>(sketch.get_total_weight());
+}
+
+/**
+ * @class SketchSerializable
+ * @brief ISerializable adapter for any datasketches-style sketch.
+ *
+ * SketchT needs a copy constructor, get_serialized_size_bytes() and
+ * serialize(std::ostream&), which covers KLL, frequent items, theta, HLL and
+ * REQ sketches. prepare() copies the sketch, so updates from other threads
+ * only race with the copy, as they did with serialize().
+ */
+template<typename SketchT>
+class SketchSerializable : public ISerializable {
+public:
+  explicit SketchSerializable(SketchT *sketch) : sketch_(sketch) {}
+
+  uint64_t generation() const override { return sketchGeneration(*sketch_); }
+  bool supports_drain() const override { return false; }
+  bool prepare(bool) override {
+    frozen_.emplace(*sketch_);
+    return true;
+  }
+  size_t serialized_size() const override { return frozen_->get_serialized_size_bytes(); }
+  size_t serialize_into(uint8_t *dst, size_t capacity) const override {
+    return serializeSketch(*frozen_, dst, capacity);
+  }
+  void release(bool) override { frozen_.reset(); }
+
+  /** @brief Writes a sketch through a spanbuf; 0 if it overflowed capacity. */
+  static size_t serializeSketch(const SketchT &sketch, uint8_t *dst, size_t capacity) {
+    spanbuf buf(dst, capacity);
+    std::ostream os(&buf);
+    sketch.serialize(os);
+    return os ? buf.written() : 0;
+  }
+
+private:
+  SketchT *sketch_;
+  std::optional<SketchT> frozen_;
+};
+
+/**
+ * @brief Sharded sketches: the shards are merged (or drained) on prepare().
+ */
+template<typename SketchT>
+class SketchSerializable<ShardedSketch<SketchT>> : public ISerializable {
+public:
+  explicit SketchSerializable(ShardedSketch<SketchT> *sketch) : sketch_(sketch) {}
+
+  uint64_t generation() const override { return sketch_->generation(); }
+  bool supports_drain() const override { return true; }
+  bool prepare(bool drain) override {
+    // The merged copy is private to the save thread, producers keep updating their shards
+    drained_ = drain;
+    if (!drain) {
+      frozen_.emplace(sketch_->snapshot());
+      return true;
+    }
+    frozen_.emplace(sketch_->drain());
+    if (undelivered_) {
+      // The delta of a failed append goes out with this one
+      undelivered_->merge(std::move(*frozen_));
+      frozen_.swap(undelivered_);
+      undelivered_.reset();
+    }
+    return !frozen_->is_empty();
+  }
+  size_t serialized_size() const override { return frozen_->get_serialized_size_bytes(); }
+  size_t serialize_into(uint8_t *dst, size_t capacity) const override {
+    return SketchSerializable<SketchT>::serializeSketch(*frozen_, dst, capacity);
+  }
+  void release(bool written) override {
+    if (drained_ && !written && frozen_) {
+      // The shards no longer hold these updates, so this copy is the only one
+      undelivered_.swap(frozen_);
+    }
+    frozen_.reset();
+  }
+
+private:
+  ShardedSketch<SketchT> *sketch_;
+  std::optional<SketchT> frozen_;
+  std::optional<SketchT> undelivered_;  // Drained delta not yet in the log
+  bool drained_ = false;
+};
+
+#endif // SERIALIZABLE_H
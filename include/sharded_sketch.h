@@ -0,0 +1,142 @@
+/**
+ * @file sharded_sketch.h
+ * @brief Sketch wrapper that lets several producer threads update one statistic.
+ */
+
+#ifndef SHARDED_SKETCH_H
+#define SHARDED_SKETCH_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Stable small index of the calling thread, assigned on first use.
+ */
+inline size_t shardThreadIndex() {
+  static std::atomic<size_t> next_index(0);
+  static thread_local size_t index = next_index.fetch_add(1, std::memory_order_relaxed);
+  return index;
+}
+
+/**
+ * @class ShardedSketch
+ * @brief Stripes updates of a mergeable sketch (KLL, frequent items) across shards.
+ *
+ * Each thread updates the shard picked by its thread index, guarded by a
+ * per-shard spin flag that is only contended when two producers share a shard
+ * or while the saver merges it. snapshot() merges every shard into a copy of
+ * the empty prototype, which is what gets serialized. Shard sketches are
+ * allocated on first update, so unused shards cost one pointer.
+ *
+ * @tparam SketchT Sketch type providing update(...) and merge(const SketchT&).
+ */
+template<typename SketchT>
+class ShardedSketch {
+public:
+  /**
+   * @param prototype Empty sketch copied for every shard and for each snapshot.
+   * @param shards Number of shards; 0 uses the hardware concurrency.
+   */
+  explicit ShardedSketch(const SketchT &prototype = SketchT(), size_t shards = 0)
+      : prototype_(prototype),
+        shards_(shards != 0 ? shards : std::max(1u, std::thread::hardware_concurrency())) {}
+
+  ShardedSketch(const ShardedSketch&) = delete;
+  ShardedSketch& operator=(const ShardedSketch&) = delete;
+
+  /**
+   * @brief Forwards to SketchT::update on the calling thread's shard.
+   */
+  template<typename... Args>
+  void update(Args&&... args) {
+    shard_t &shard = shards_[shardThreadIndex() % shards_.size()];
+    lock(shard);
+    if (!shard.sketch) {
+      shard.sketch.reset(new SketchT(prototype_));
+    }
+    shard.sketch->update(std::forward<Args>(args)...);
+    // Only the lock holder writes the counter, so a plain load/store is enough
+    shard.updates.store(shard.updates.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    unlock(shard);
+  }
+
+  /**
+   * @brief Number of update() calls so far; changes whenever the snapshot may have changed.
+   */
+  uint64_t generation() const {
+    uint64_t total = 0;
+    for (const auto &shard : shards_) {
+      total += shard.updates.load(std::memory_order_relaxed);
+    }
+    return total;
+  }
+
+  /**
+   * @brief Merges all shards into a new sketch.
+   *
+   * Each shard is only locked while it is copied; the merge runs on the
+   * copies, so producers never wait for it.
+   */
+  SketchT snapshot() const {
+    SketchT result(prototype_);
+    for (auto &shard : shards_) {
+      lock(shard);
+      if (!shard.sketch) {
+        unlock(shard);
+        continue;
+      }
+      SketchT copy(*shard.sketch);
+      unlock(shard);
+      result.merge(std::move(copy));
+    }
+    return result;
+  }
+
+  /**
+   * @brief Merges all shards into a new sketch and empties them.
+   *
+   * The result is the delta since the previous drain(). Shards are detached
+   * under their lock, so no update is lost or counted twice.
+   */
+  SketchT drain() {
+    SketchT result(prototype_);
+    for (auto &shard : shards_) {
+      lock(shard);
+      std::unique_ptr<SketchT> taken(std::move(shard.sketch));
+      unlock(shard);
+      if (taken) {
+        result.merge(std::move(*taken));
+      }
+    }
+    return result;
+  }
+
+  size_t shard_count() const { return shards_.size(); }
+
+private:
+  // One cache line per shard so producers on different shards do not share lines
+  struct alignas(64) shard_t {
+    std::atomic_flag busy = ATOMIC_FLAG_INIT;
+    std::atomic<uint64_t> updates{0};
+    std::unique_ptr<SketchT> sketch;
+  };
+
+  static void lock(shard_t &shard) {
+    while (shard.busy.test_and_set(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+  }
+  static void unlock(shard_t &shard) {
+    shard.busy.clear(std::memory_order_release);
+  }
+
+  const SketchT prototype_;
+  mutable std::vector<shard_t> shards_;
+};
+
+#endif // SHARDED_SKETCH_H
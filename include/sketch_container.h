@@ -0,0 +1,87 @@
+/**
+ * @file sketch_container.h
+ * @brief Single-file container holding every sketch saved by one Saver.
+ */
+
+#ifndef SKETCH_CONTAINER_H
+#define SKETCH_CONTAINER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief One serialized sketch to store in a container.
+ */
+typedef struct {
+    std::string name;      ///< Lookup key, the base name of the registered file
+    int type;              ///< data_object_type_e of the object
+    const uint8_t *data;   ///< Serialized sketch
+    size_t size;
+} sketch_container_entry_t;
+
+/**
+ * @brief CRC-32 (IEEE, as zlib) of a buffer.
+ */
+uint32_t sketchChecksum(const uint8_t *data, size_t size);
+
+/**
+ * @brief Encodes named sketches as one container image.
+ *
+ * Layout, little endian:
+ *   header  "DTC1", u32 version, u32 count, u32 index crc, u64 file size
+ *   index   count x {u64 offset, u64 size, u32 type, u32 blob crc, u32 name offset, u32 name size}
+ *   names   entry names, concatenated
+ *   blobs   serialized sketches, each starting on an 8-byte boundary
+ * Index entries are sorted by name so readers can binary search them.
+ *
+ * @param entries Sketches to store; of entries sharing a name only the first is stored.
+ * @param out Receives the container image.
+ */
+void encodeSketchContainer(const std::vector<sketch_container_entry_t> &entries, std::vector<uint8_t> &out);
+
+/**
+ * @class SketchContainer
+ * @brief Read-only, memory-mapped view of a container file.
+ *
+ * find() returns pointers into the mapping, so a sketch can be deserialized
+ * without copying the file or reading the other entries.
+ */
+class SketchContainer {
+public:
+  SketchContainer();
+  ~SketchContainer();
+
+  SketchContainer(const SketchContainer&) = delete;
+  SketchContainer& operator=(const SketchContainer&) = delete;
+
+  /**
+   * @brief Maps a container file and validates its header and index.
+   * @return true if the file is a valid container.
+   */
+  bool open(const std::string &path);
+  void close();
+
+  size_t size() const { return count_; }
+  std::vector<std::string> names() const;
+
+  /**
+   * @brief Looks up a sketch by name and verifies its checksum.
+   * @param name Base name the sketch was registered with, e.g. "noise.bin".
+   * @param data Receives a pointer into the mapping, valid until close().
+   * @param size Receives the serialized size.
+   * @param type Optionally receives the data_object_type_e of the entry.
+   * @return true if found and intact.
+   */
+  bool find(const std::string &name, const uint8_t **data, size_t *size, int *type = nullptr) const;
+
+#ifndef TEST
+private:
+#endif
+  const uint8_t *map_;
+  size_t length_;
+  uint32_t count_;
+};
+
+#endif // SKETCH_CONTAINER_H
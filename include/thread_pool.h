@@ -0,0 +1,109 @@
+/**
+ * @file thread_pool.h
+ * @brief Small fixed-size worker pool used to fan out per-item work.
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ThreadPool
+ * @brief Runs submitted tasks on a fixed set of worker threads.
+ *
+ * Workers are started once in the constructor and joined in the destructor,
+ * so per-batch fan-out does not pay for thread creation.
+ */
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t threads) : stop_(false) {
+    if (threads == 0) threads = 1;
+    for (size_t i = 0; i < threads; ++i) {
+      workers_.emplace_back(&ThreadPool::workerLoop, this);
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto &worker : workers_) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /**
+   * @brief Queues a task.
+   * @return A future that becomes ready when the task has run; it carries any exception thrown.
+   */
+  std::future<void> submit(std::function<void()> task) {
+    auto packaged = std::make_shared<std::packaged_task<void()>>(std::move(task));
+    std::future<void> result = packaged->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.emplace([packaged] { (*packaged)(); });
+    }
+    cv_.notify_one();
+    return result;
+  }
+
+  /**
+   * @brief Runs fn(i) for every i in [0, count) across the workers and waits for all of them.
+   *
+   * Indices are split into one contiguous chunk per worker. The first exception
+   * thrown by fn is rethrown after every chunk has finished.
+   */
+  void parallelFor(size_t count, const std::function<void(size_t)> &fn) {
+    const size_t chunks = std::min(count, workers_.size());
+    std::vector<std::future<void>> pending;
+    pending.reserve(chunks);
+    for (size_t c = 0; c < chunks; ++c) {
+      const size_t begin = count * c / chunks;
+      const size_t end = count * (c + 1) / chunks;
+      pending.push_back(submit([&fn, begin, end] {
+        for (size_t i = begin; i < end; ++i) fn(i);
+      }));
+    }
+    for (auto &p : pending) p.wait();
+    for (auto &p : pending) p.get();
+  }
+
+  size_t size() const { return workers_.size(); }
+
+private:
+  void workerLoop() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+        if (stop_ && tasks_.empty()) return;
+        task = std::move(tasks_.front());
+        tasks_.pop();
+      }
+      task();
+    }
+  }
+
+  bool stop_;
+  std::vector<std::thread> workers_;
+  std::queue<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,120 @@
+#ifndef UPLOAD_SPOOL_H
+#define UPLOAD_SPOOL_H
+
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef enum {
+    SPOOL_PENDING,   ///< Waiting for its first attempt or for its backoff to elapse
+    SPOOL_DONE,      ///< Uploaded; not sent again while the file is unchanged
+    SPOOL_STATE_MAX
+} spool_state_e;
+
+typedef struct {
+    std::string path;
+    std::string sensorId;
+    time_t timestamp;
+    uint64_t size;           // Identity of the version being uploaded,
+    int64_t mtime_ns;        // a different size or mtime is a new version
+    spool_state_e state;
+    uint32_t attempts;       // Failed attempts so far
+    int64_t next_attempt_ms; // Wall clock, ms since the epoch; survives a restart
+    bool in_flight;          // Handed out by due(), not journaled
+} spool_entry_t;
+
+typedef struct {
+    int64_t base_backoff_ms;   ///< Delay after the first failure, doubled per further failure
+    int64_t max_backoff_ms;    ///< Cap of the doubled delay
+    uint32_t max_attempts;     ///< Give up on a version after this many failures, 0 never
+    size_t compact_records;    ///< Rewrite the journal once it holds this many records
+    bool sync;                 ///< fdatasync after every record, survives a power loss
+} upload_spool_config_t;
+
+/**
+ * @brief Default configuration: 1 s backoff doubling up to 10 min, unlimited attempts.
+ */
+upload_spool_config_t defaultUploadSpoolConfig();
+
+/**
+ * @class UploadSpool
+ * @brief On-disk queue of files to upload, with retry backoff and completion tracking.
+ *
+ * Every state change is appended to a journal, one line per record, so the
+ * spool is rebuilt by replaying it after a crash or restart. A torn last line
+ * is ignored. open() and every compact_records appends rewrite the journal
+ * with only the live entries.
+ *
+ * A version of a file (path, size, mtime) is marked done at most once and is
+ * never handed out again after that; it is only queued again when the file
+ * changes. An upload that was running when the process died is not known to
+ * have completed, so it is sent again after the restart.
+ */
+class UploadSpool {
+public:
+    explicit UploadSpool(const std::string& journalPath,
+                         upload_spool_config_t config = defaultUploadSpoolConfig());
+    ~UploadSpool();
+
+    UploadSpool(const UploadSpool&) = delete;
+    UploadSpool& operator=(const UploadSpool&) = delete;
+
+    /**
+     * @brief Replays the journal and reopens it for appending.
+     * @return false if the journal can't be written.
+     */
+    bool open();
+
+    /**
+     * @brief Queues the current version of a file.
+     * @return true if it was queued, false if it is already queued or done, or can't be read.
+     */
+    bool enqueue(const std::string& path, const std::string& sensorId, time_t timestamp);
+
+    /**
+     * @brief Pending entries whose backoff has elapsed, marked in flight until markDone() or markFailed().
+     *
+     * Files that disappeared are dropped, files that changed since enqueue() are
+     * handed out with their new version.
+     */
+    std::vector<spool_entry_t> due(size_t max = SIZE_MAX);
+
+    /** @brief Records the version handed out by due() as uploaded. */
+    void markDone(const spool_entry_t& entry);
+
+    /** @brief Schedules another attempt after an exponential, jittered backoff. */
+    void markFailed(const spool_entry_t& entry);
+
+    /** @brief Milliseconds until the next pending entry is due, -1 if none is waiting. */
+    int64_t nextDueMs();
+
+    size_t pending();
+    size_t done();
+    bool find(const std::string& path, spool_entry_t& entry);
+
+    /** @brief Rewrites the journal with the live entries; done entries of deleted files are forgotten. */
+    bool compact();
+
+#ifndef TEST
+private:
+#endif
+    bool replay();
+    bool appendRecord(const std::string& record);
+    bool compactLocked();
+    void compactIfNeeded();
+    int64_t backoffMs(uint32_t attempts);
+
+    std::string journalPath_;
+    upload_spool_config_t config_;
+    int fd_;
+    size_t records_;           ///< Lines in the journal since the last rewrite
+    std::mutex mutex_;
+    std::map<std::string, spool_entry_t> entries_;
+    std::mt19937_64 rng_;
+};
+
+#endif // UPLOAD_SPOOL_H
@@ -0,0 +1,91 @@
+/**
+ * @file tar_gz_benchmark.cpp
+ * @brief Throughput of the TarGzCreator archive paths on a synthetic sample folder.
+ *
+ * Usage: tar_gz_benchmark [size_mib] [threads]
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <boost/filesystem.hpp>
+#include "tar_gz_creator.h"
+
+namespace fs = boost::filesystem;
+
+// Sample-like content: runs of repeated bytes mixed with noise, compresses about 3:1
+static void writeSampleFile(const std::string& path, size_t size, std::mt19937& rng) {
+    std::vector<char> data(size);
+    size_t i = 0;
+    while (i < size) {
+        size_t run = 1 + rng() % 64;
+        char value = static_cast<char>(rng() % 256);
+        bool noise = rng() % 4 == 0;
+        for (size_t k = 0; k < run && i < size; ++k, ++i) {
+            data[i] = noise ? static_cast<char>(rng()) : value;
+        }
+    }
+    std::ofstream(path, std::ios::binary).write(data.data(), data.size());
+}
+
+static void report(const std::string& name, size_t inputBytes, const std::string& output,
+                   const std::function<bool()>& run) {
+    auto start = std::chrono::steady_clock::now();
+    bool ok = run();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!ok) {
+        std::cout << std::left << std::setw(28) << name << "failed or unavailable" << std::endl;
+        return;
+    }
+    double outSize = static_cast<double>(fs::file_size(output));
+    std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(8) << inputBytes / seconds / (1024 * 1024) << " MiB/s"
+              << std::setw(8) << std::setprecision(2) << inputBytes / outSize << "x ratio" << std::endl;
+    fs::remove(output);
+}
+
+int main(int argc, char **argv) {
+    size_t sizeMib = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256;
+    size_t threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+
+    const std::string folder = "tar_gz_benchmark_data";
+    fs::create_directories(folder);
+    std::mt19937 rng(42);
+    const size_t fileSize = 4 * 1024 * 1024;
+    size_t total = 0;
+    for (size_t i = 0; total < sizeMib * 1024 * 1024; ++i) {
+        writeSampleFile(folder + "/sample_" + std::to_string(i) + ".bin", fileSize, rng);
+        total += fileSize;
+    }
+
+    TarGzCreator creator;
+    std::vector<std::string> files = creator.collectFilesFromFolders({folder});
+    std::cout << "input " << total / (1024 * 1024) << " MiB in " << files.size() << " files, "
+              << threads << " threads" << std::endl;
+
+    report("createTar + compressToGz", total, "bench.tar.gz", [&] {
+        bool ok = creator.createTar("bench.tar", files) && creator.compressToGz("bench.tar", "bench.tar.gz");
+        fs::remove("bench.tar");
+        return ok;
+    });
+    report("createTarGz (streaming)", total, "bench.tar.gz", [&] {
+        return creator.createTarGz("bench.tar.gz", files);
+    });
+    for (size_t n = 1; n <= threads; n *= 2) {
+        report("createTarGzParallel x" + std::to_string(n), total, "bench.tar.gz", [&] {
+            return creator.createTarGzParallel("bench.tar.gz", files, n);
+        });
+    }
+    report("createTarZst x" + std::to_string(threads), total, "bench.tar.zst", [&] {
+        return creator.createTarZst("bench.tar.zst", files, threads);
+    });
+
+    fs::remove_all(folder);
+    return 0;
+}
@@ -0,0 +1,223 @@
+#include "change_tracker.h"
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <set>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "datatracer_log.h"
+
+#ifdef __linux__
+static const uint32_t kWatchMask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM;
+#endif
+
+static bool statVersion(const std::string &path, file_version_t &version) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    version.inode = static_cast<uint64_t>(st.st_ino);
+    version.size = static_cast<uint64_t>(st.st_size);
+#ifdef __APPLE__
+    version.mtime_ns = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    version.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    version.hash = 0;
+    return true;
+}
+
+static bool sameStat(const file_version_t &a, const file_version_t &b) {
+    return a.inode == b.inode && a.size == b.size && a.mtime_ns == b.mtime_ns;
+}
+
+// FNV-1a, 64 bit
+static bool hashFile(const std::string &path, uint64_t &hash) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    hash = 14695981039346656037ULL;
+    unsigned char buffer[64 * 1024];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            return false;
+        }
+        for (ssize_t i = 0; i < n; i++) {
+            hash = (hash ^ buffer[i]) * 1099511628211ULL;
+        }
+    }
+    close(fd);
+    return true;
+}
+
+ChangeTracker::ChangeTracker(const std::string &path, bool useInotify)
+    : dir_(path), inotify_fd_(-1), scanned_(false), scans_(0), hashed_(0) {
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+        size_t slash = path.find_last_of('/');
+        dir_ = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+        only_ = slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+#ifdef __linux__
+    if (useInotify) {
+        // Watch before the first scan, so nothing written in between is missed
+        inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd_ >= 0 && inotify_add_watch(inotify_fd_, dir_.c_str(), kWatchMask) < 0) {
+            log_info << "not watching " << dir_ << ", rescanning instead: " << strerror(errno) << std::endl;
+            close(inotify_fd_);
+            inotify_fd_ = -1;
+        }
+    }
+#else
+    (void)useInotify;
+#endif
+}
+
+ChangeTracker::~ChangeTracker() {
+    if (inotify_fd_ >= 0) {
+        close(inotify_fd_);
+    }
+}
+
+bool ChangeTracker::tracked(const std::string &name) const {
+    return !name.empty() && name[0] != '.' && (only_.empty() || name == only_);
+}
+
+void ChangeTracker::forget(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uploaded_.erase(path);
+    reported_.erase(path);
+}
+
+std::vector<changed_file_t> ChangeTracker::changed() {
+    std::vector<changed_file_t> out;
+    if (!scanned_ || inotify_fd_ < 0) {
+        scan(out);
+        scanned_ = true;
+        return out;
+    }
+
+    std::vector<std::string> paths;
+    if (!readEvents(paths)) {
+        log_info << dir_ << ": inotify queue overflowed, rescanning" << std::endl;
+        scan(out);
+        return out;
+    }
+    std::set<std::string> unique(paths.begin(), paths.end());
+    for (const std::string &path : unique) {
+        check(path, out);
+    }
+    return out;
+}
+
+bool ChangeTracker::readEvents(std::vector<std::string> &paths) {
+    bool overflow = false;
+#ifdef __linux__
+    alignas(struct inotify_event) char buffer[16 * 1024];
+    while (true) {
+        ssize_t n = read(inotify_fd_, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        for (ssize_t offset = 0; offset < n;) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(buffer + offset);
+            offset += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflow = true;
+            } else if (event->len > 0 && tracked(event->name)) {
+                paths.push_back(dir_ + "/" + event->name);
+            }
+        }
+    }
+#else
+    (void)paths;
+#endif
+    return !overflow;
+}
+
+void ChangeTracker::scan(std::vector<changed_file_t> &out) {
+    scans_++;
+    std::set<std::string> present;
+    DIR *dir = opendir(dir_.c_str());
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            if (tracked(entry->d_name)) {
+                present.insert(dir_ + "/" + entry->d_name);
+            }
+        }
+        closedir(dir);
+    }
+    for (const std::string &path : present) {
+        check(path, out);
+    }
+
+    // Deletions seen by a rescan
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = uploaded_.begin(); it != uploaded_.end();) {
+        it = present.count(it->first) ? std::next(it) : uploaded_.erase(it);
+    }
+    for (auto it = reported_.begin(); it != reported_.end();) {
+        it = present.count(it->first) ? std::next(it) : reported_.erase(it);
+    }
+}
+
+void ChangeTracker::check(const std::string &path, std::vector<changed_file_t> &out) {
+    file_version_t version;
+    if (!statVersion(path, version)) {
+        forget(path);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto up = uploaded_.find(path);
+        if (up != uploaded_.end() && sameStat(up->second, version)) {
+            return;
+        }
+        auto rep = reported_.find(path);
+        if (rep != reported_.end() && sameStat(rep->second, version)) {
+            return;
+        }
+    }
+
+    // Hashing reads the whole file, done without the lock so upload callbacks are not held up
+    if (!hashFile(path, version.hash)) {
+        return;
+    }
+    hashed_++;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto up = uploaded_.find(path);
+    if (up != uploaded_.end() && up->second.size == version.size && up->second.hash == version.hash) {
+        // Touched or rewritten with the same contents, nothing to send
+        up->second = version;
+        reported_.erase(path);
+        return;
+    }
+    reported_[path] = version;
+    out.push_back({path, version});
+}
+
+void ChangeTracker::markUploaded(const std::string &path, uint64_t size, int64_t mtime_ns) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto rep = reported_.find(path);
+    if (rep == reported_.end() || rep->second.size != size || rep->second.mtime_ns != mtime_ns) {
+        return;
+    }
+    uploaded_[path] = rep->second;
+    reported_.erase(rep);
+}
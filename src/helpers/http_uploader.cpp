@@ -1,65 +1,363 @@
 #include "http_uploader.h"
 #include <fstream>
-#include <vector>
 #include <ctime>
 
-HttpUploader::HttpUploader(const std::string& endpointUrl, const std::string& token)
-    : endpointUrl_(endpointUrl), token_(token) {}
+// Chunk libcurl reads from the file per send
+static const long kUploadBufferSize = 256 * 1024;
 
-bool HttpUploader::postFile(const std::string& filePath, const std::string& sensorId, time_t timestamp) {
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        return false;
+HttpUploader::HttpUploader(const std::string& endpointUrl, const std::string& token, size_t poolSize,
+                           size_t maxConcurrent)
+    : endpointUrl_(endpointUrl), token_(token), poolSize_(poolSize), headers_(nullptr), share_(nullptr),
+      connects_(0), maxConcurrent_(maxConcurrent > 0 ? maxConcurrent : 1), multi_(nullptr), inFlight_(0),
+      stop_(false), completed_(0), failed_(0), bytesSent_(0), busy_(0) {
+    // curl_global_init is not thread-safe, do it once before any handle exists
+    static std::once_flag curlInit;
+    std::call_once(curlInit, [] { curl_global_init(CURL_GLOBAL_DEFAULT); });
+
+    headers_ = curl_slist_append(headers_, ("Authorization: Bearer " + token_).c_str());
+    // No 100-continue round trip before large bodies
+    headers_ = curl_slist_append(headers_, "Expect:");
+
+    share_ = curl_share_init();
+    if (share_) {
+        curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, &HttpUploader::lockShare);
+        curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, &HttpUploader::unlockShare);
+        curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
     }
 
-    CURLcode res;
-    std::ifstream file(filePath, std::ios::binary | std::ios::ate);
-    if (!file.is_open()) {
+    multi_ = curl_multi_init();
+    if (multi_) {
+        // Streams of one HTTP/2 connection where possible, otherwise up to maxConcurrent connections
+        curl_multi_setopt(multi_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        curl_multi_setopt(multi_, CURLMOPT_MAX_TOTAL_CONNECTIONS, static_cast<long>(maxConcurrent_));
+    }
+}
+
+HttpUploader::~HttpUploader() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        stop_ = true;
+    }
+    if (multi_) {
+        curl_multi_wakeup(multi_);
+    }
+    if (loopThread_.joinable()) {
+        loopThread_.join();
+    }
+    if (multi_) {
+        curl_multi_cleanup(multi_);
+    }
+    for (CURL* curl : idle_) {
         curl_easy_cleanup(curl);
-        return false;
     }
+    idle_.clear();
+    if (share_) {
+        curl_share_cleanup(share_);
+    }
+    curl_slist_free_all(headers_);
+}
 
-    std::streamsize fileSize = file.tellg();
-    file.seekg(0, std::ios::beg);
+void HttpUploader::lockShare(CURL*, curl_lock_data data, curl_lock_access, void* userptr) {
+    static_cast<HttpUploader*>(userptr)->shareMutex_[data].lock();
+}
 
-    std::vector<char> fileBuffer(fileSize);
-    file.read(fileBuffer.data(), fileSize);
+void HttpUploader::unlockShare(CURL*, curl_lock_data data, void* userptr) {
+    static_cast<HttpUploader*>(userptr)->shareMutex_[data].unlock();
+}
 
+CURL* HttpUploader::acquireHandle() {
+    {
+        std::lock_guard<std::mutex> lock(poolMutex_);
+        if (!idle_.empty()) {
+            CURL* curl = idle_.back();
+            idle_.pop_back();
+            return curl;
+        }
+    }
+    CURL* curl = curl_easy_init();
+    if (!curl) {
+        return nullptr;
+    }
+    // Options that are the same for every upload are set once per handle
     curl_easy_setopt(curl, CURLOPT_URL, endpointUrl_.c_str());
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers_);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_UPLOAD_BUFFERSIZE, kUploadBufferSize);
+    // HTTP/2 when TLS ALPN agrees on it, HTTP/1.1 otherwise
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    if (share_) {
+        curl_easy_setopt(curl, CURLOPT_SHARE, share_);
+    }
+    return curl;
+}
 
-    struct curl_slist* headers = nullptr;
-    headers = curl_slist_append(headers, ("Authorization: Bearer " + token_).c_str());
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+void HttpUploader::releaseHandle(CURL* curl) {
+    {
+        std::lock_guard<std::mutex> lock(poolMutex_);
+        if (idle_.size() < poolSize_) {
+            idle_.push_back(curl);
+            return;
+        }
+    }
+    curl_easy_cleanup(curl);
+}
 
-    struct curl_httppost* formpost = nullptr;
-    struct curl_httppost* lastptr = nullptr;
+curl_mime* HttpUploader::buildForm(CURL* curl, const std::string& filePath, const std::string& sensorId,
+                                   time_t timestamp) {
+    {
+        std::ifstream file(filePath, std::ios::binary);
+        if (!file.is_open()) {
+            return nullptr;
+        }
+    }
 
     // Adding metadata and the file to the form
-    curl_formadd(&formpost, &lastptr,
-        CURLFORM_COPYNAME, "sensor_id",
-        CURLFORM_COPYCONTENTS, sensorId.c_str(),
-        CURLFORM_END);
+    curl_mime* mime = curl_mime_init(curl);
+    curl_mimepart* part = curl_mime_addpart(mime);
+    curl_mime_name(part, "sensor_id");
+    curl_mime_data(part, sensorId.c_str(), CURL_ZERO_TERMINATED);
 
-    curl_formadd(&formpost, &lastptr,
-        CURLFORM_COPYNAME, "timestamp",
-        CURLFORM_COPYCONTENTS, std::to_string(timestamp).c_str(),
-        CURLFORM_END);
+    part = curl_mime_addpart(mime);
+    curl_mime_name(part, "timestamp");
+    curl_mime_data(part, std::to_string(timestamp).c_str(), CURL_ZERO_TERMINATED);
 
-    curl_formadd(&formpost, &lastptr,
-        CURLFORM_COPYNAME, "file",
-        CURLFORM_BUFFER, filePath.c_str(),
-        CURLFORM_BUFFERLENGTH, fileBuffer.size(),
-        CURLFORM_BUFFERPTR, fileBuffer.data(),
-        CURLFORM_END);
+    // libcurl reads the file while sending, through its upload buffer, so
+    // memory use does not depend on the file size
+    part = curl_mime_addpart(mime);
+    curl_mime_name(part, "file");
+    if (curl_mime_filedata(part, filePath.c_str()) != CURLE_OK) {
+        curl_mime_free(mime);
+        return nullptr;
+    }
+    curl_mime_filename(part, filePath.c_str());
+    return mime;
+}
 
-    curl_easy_setopt(curl, CURLOPT_HTTPPOST, formpost);
+bool HttpUploader::postFile(const std::string& filePath, const std::string& sensorId, time_t timestamp) {
+    CURL* curl = acquireHandle();
+    if (!curl) {
+        return false;
+    }
+    curl_mime* mime = buildForm(curl, filePath, sensorId, timestamp);
+    if (!mime) {
+        releaseHandle(curl);
+        return false;
+    }
 
-    res = curl_easy_perform(curl);
+    curl_easy_setopt(curl, CURLOPT_MIMEPOST, mime);
+    CURLcode res = curl_easy_perform(curl);
 
-    curl_formfree(formpost);
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
+    long connects = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects) == CURLE_OK) {
+        connects_ += static_cast<uint64_t>(connects);
+    }
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
 
-    return res == CURLE_OK;
+    // The handle outlives the form, detach it before freeing
+    curl_easy_setopt(curl, CURLOPT_MIMEPOST, nullptr);
+    curl_mime_free(mime);
+    releaseHandle(curl);
+
+    return res == CURLE_OK && status < 400;
+}
+
+void HttpUploader::postFileAsync(const std::string& filePath, const std::string& sensorId, time_t timestamp,
+                                 upload_callback_t done) {
+    transfer_t* transfer = new transfer_t;
+    transfer->filePath = filePath;
+    transfer->sensorId = sensorId;
+    transfer->timestamp = timestamp;
+    transfer->done = done;
+    transfer->curl = nullptr;
+    transfer->mime = nullptr;
+
+    if (!multi_) {
+        upload_result_t result = {filePath, false, CURLE_FAILED_INIT, 0, 0, 0.0};
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            if (inFlight_++ == 0) {
+                busySince_ = std::chrono::steady_clock::now();
+            }
+        }
+        complete(transfer, result);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        queue_.push_back(transfer);
+        if (!loopThread_.joinable()) {
+            loopThread_ = std::thread(&HttpUploader::eventLoop, this);
+        }
+    }
+    curl_multi_wakeup(multi_);
+}
+
+void HttpUploader::waitIdle() {
+    std::unique_lock<std::mutex> lock(queueMutex_);
+    idleCv_.wait(lock, [this] { return queue_.empty() && inFlight_ == 0; });
+}
+
+upload_stats_t HttpUploader::getStats() {
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    std::chrono::steady_clock::duration busy = busy_;
+    if (inFlight_ > 0) {
+        busy += std::chrono::steady_clock::now() - busySince_;
+    }
+    upload_stats_t stats;
+    stats.completed = completed_;
+    stats.failed = failed_;
+    stats.bytesSent = bytesSent_;
+    stats.queued = queue_.size();
+    stats.inFlight = inFlight_;
+    stats.busySeconds = std::chrono::duration<double>(busy).count();
+    stats.filesPerSecond = stats.busySeconds > 0 ? completed_ / stats.busySeconds : 0.0;
+    stats.bytesPerSecond = stats.busySeconds > 0 ? bytesSent_ / stats.busySeconds : 0.0;
+    return stats;
+}
+
+// Moves queued uploads onto the multi handle while there are free slots
+void HttpUploader::startTransfers() {
+    while (true) {
+        transfer_t* transfer;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            if (queue_.empty() || inFlight_ >= maxConcurrent_) {
+                return;
+            }
+            transfer = queue_.front();
+            queue_.pop_front();
+            if (inFlight_++ == 0) {
+                busySince_ = std::chrono::steady_clock::now();
+            }
+        }
+
+        transfer->started = std::chrono::steady_clock::now();
+        transfer->curl = acquireHandle();
+        if (transfer->curl) {
+            transfer->mime = buildForm(transfer->curl, transfer->filePath, transfer->sensorId, transfer->timestamp);
+        }
+        if (!transfer->mime) {
+            if (transfer->curl) {
+                releaseHandle(transfer->curl);
+            }
+            upload_result_t result = {transfer->filePath, false, CURLE_READ_ERROR, 0, 0, 0.0};
+            complete(transfer, result);
+            continue;
+        }
+
+        curl_easy_setopt(transfer->curl, CURLOPT_MIMEPOST, transfer->mime);
+        curl_easy_setopt(transfer->curl, CURLOPT_PRIVATE, transfer);
+        // Wait for an HTTP/2 connection to come up and multiplex on it rather than open another
+        curl_easy_setopt(transfer->curl, CURLOPT_PIPEWAIT, 1L);
+        curl_multi_add_handle(multi_, transfer->curl);
+        running_.push_back(transfer);
+    }
+}
+
+void HttpUploader::finishTransfer(CURL* curl, CURLcode code) {
+    transfer_t* transfer = nullptr;
+    curl_easy_getinfo(curl, CURLINFO_PRIVATE, &transfer);
+    curl_multi_remove_handle(multi_, curl);
+    for (auto it = running_.begin(); it != running_.end(); ++it) {
+        if (*it == transfer) {
+            running_.erase(it);
+            break;
+        }
+    }
+
+    upload_result_t result = {transfer->filePath, false, code, 0, 0, 0.0};
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &result.status);
+    curl_off_t sent = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &sent) == CURLE_OK) {
+        result.bytesSent = static_cast<uint64_t>(sent);
+    }
+    long connects = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects) == CURLE_OK) {
+        connects_ += static_cast<uint64_t>(connects);
+    }
+    result.ok = code == CURLE_OK && result.status > 0 && result.status < 400;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - transfer->started).count();
+
+    curl_easy_setopt(curl, CURLOPT_MIMEPOST, nullptr);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, nullptr);
+    curl_mime_free(transfer->mime);
+    releaseHandle(curl);
+    complete(transfer, result);
+}
+
+// Runs the callback, then counts the upload; waitIdle() returns only after the last callback
+void HttpUploader::complete(transfer_t* transfer, upload_result_t& result) {
+    if (transfer->done) {
+        transfer->done(result);
+    }
+    delete transfer;
+
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    if (result.ok) {
+        completed_++;
+    } else {
+        failed_++;
+    }
+    bytesSent_ += result.bytesSent;
+    if (--inFlight_ == 0) {
+        busy_ += std::chrono::steady_clock::now() - busySince_;
+    }
+    idleCv_.notify_all();
+}
+
+void HttpUploader::eventLoop() {
+    while (true) {
+        startTransfers();
+
+        int running = 0;
+        curl_multi_perform(multi_, &running);
+        CURLMsg* msg;
+        int pending;
+        while ((msg = curl_multi_info_read(multi_, &pending)) != nullptr) {
+            if (msg->msg == CURLMSG_DONE) {
+                // msg is invalidated once the handle is removed
+                CURL* curl = msg->easy_handle;
+                finishTransfer(curl, msg->data.result);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            if (stop_) {
+                break;
+            }
+            // A completion freed a slot for a queued upload, start it without waiting
+            if (!queue_.empty() && inFlight_ < maxConcurrent_) {
+                continue;
+            }
+        }
+        // Sleeps until socket activity, a libcurl timeout or curl_multi_wakeup() from postFileAsync
+        curl_multi_poll(multi_, nullptr, 0, 1000, nullptr);
+    }
+
+    // Shutting down: whatever did not finish is reported as failed
+    while (!running_.empty()) {
+        finishTransfer(running_.back()->curl, CURLE_ABORTED_BY_CALLBACK);
+    }
+    while (true) {
+        transfer_t* transfer;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            if (queue_.empty()) {
+                break;
+            }
+            transfer = queue_.front();
+            queue_.pop_front();
+            if (inFlight_++ == 0) {
+                busySince_ = std::chrono::steady_clock::now();
+            }
+        }
+        upload_result_t result = {transfer->filePath, false, CURLE_ABORTED_BY_CALLBACK, 0, 0, 0.0};
+        complete(transfer, result);
+    }
 }
@@ -1,17 +1,139 @@
 #ifndef HTTP_UPLOADER_H
 #define HTTP_UPLOADER_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 #include <curl/curl.h>
 
+/** @brief Outcome of one upload, passed to its completion callback. */
+typedef struct {
+    std::string filePath;
+    bool ok;              ///< Transfer completed with a status below 400
+    CURLcode code;
+    long status;          ///< HTTP status, 0 when no response arrived
+    uint64_t bytesSent;   ///< Request body bytes, form fields included
+    double seconds;       ///< Time from start of transfer to completion
+} upload_result_t;
+
+typedef std::function<void(const upload_result_t&)> upload_callback_t;
+
+/** @brief Aggregate counters of the asynchronous upload engine. */
+typedef struct {
+    uint64_t completed;
+    uint64_t failed;
+    uint64_t bytesSent;
+    size_t queued;        ///< Waiting for a free transfer slot
+    size_t inFlight;
+    double busySeconds;   ///< Time with at least one transfer running
+    double filesPerSecond;  ///< completed / busySeconds
+    double bytesPerSecond;  ///< bytesSent / busySeconds
+} upload_stats_t;
+
+/**
+ * @class HttpUploader
+ * @brief Posts files to the upload endpoint over reused keep-alive connections.
+ *
+ * Easy handles are pooled, so consecutive uploads reuse the TCP/TLS connection
+ * kept open by a handle instead of reconnecting. All handles share one DNS and
+ * TLS session cache, so a handle that has to reconnect skips the lookup and
+ * resumes the TLS session. postFile() may be called from several threads.
+ *
+ * postFileAsync() queues an upload for an event loop thread that runs up to
+ * maxConcurrent transfers at once on a curl multi handle, multiplexed as
+ * HTTP/2 streams over one connection when the server negotiates it, and
+ * over parallel keep-alive connections otherwise.
+ */
 class HttpUploader {
 public:
-    HttpUploader(const std::string& endpointUrl, const std::string& token);
+    /**
+     * @param endpointUrl Upload URL.
+     * @param token Bearer token sent with every request.
+     * @param poolSize Idle handles (and so open connections) kept between uploads.
+     * @param maxConcurrent Transfers the asynchronous engine runs at once.
+     */
+    HttpUploader(const std::string& endpointUrl, const std::string& token, size_t poolSize = 4,
+                 size_t maxConcurrent = 8);
+    /** @brief Stops the event loop; uploads still queued or running are reported as failed. */
+    ~HttpUploader();
+
+    HttpUploader(const HttpUploader&) = delete;
+    HttpUploader& operator=(const HttpUploader&) = delete;
+
     bool postFile(const std::string& filePath, const std::string& sensorId, time_t timestamp);
 
+    /**
+     * @brief Queues an upload and returns immediately.
+     * @param done Called on the event loop thread when the upload finishes; must not block.
+     */
+    void postFileAsync(const std::string& filePath, const std::string& sensorId, time_t timestamp,
+                       upload_callback_t done = nullptr);
+
+    /** @brief Blocks until every upload queued so far has completed. */
+    void waitIdle();
+
+    upload_stats_t getStats();
+
+    /** @brief Connections opened so far; stays flat while uploads reuse the pool. */
+    uint64_t getConnectionsOpened() const { return connects_.load(); }
+
+#ifndef TEST
 private:
+#endif
+    typedef struct {
+        std::string filePath;
+        std::string sensorId;
+        time_t timestamp;
+        upload_callback_t done;
+        CURL* curl;
+        curl_mime* mime;
+        std::chrono::steady_clock::time_point started;
+    } transfer_t;
+
+    CURL* acquireHandle();
+    void releaseHandle(CURL* curl);
+    curl_mime* buildForm(CURL* curl, const std::string& filePath, const std::string& sensorId, time_t timestamp);
+    void startTransfers();
+    void finishTransfer(CURL* curl, CURLcode code);
+    void complete(transfer_t* transfer, upload_result_t& result);
+    void eventLoop();
+
+    static void lockShare(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr);
+    static void unlockShare(CURL* handle, curl_lock_data data, void* userptr);
+
     std::string endpointUrl_;
     std::string token_;
+    size_t poolSize_;
+    struct curl_slist* headers_;      ///< Built once, shared by every request
+    CURLSH* share_;                   ///< DNS and TLS session cache
+    std::mutex shareMutex_[CURL_LOCK_DATA_LAST];
+    std::mutex poolMutex_;
+    std::vector<CURL*> idle_;         ///< Configured handles with their connection kept alive
+    std::atomic<uint64_t> connects_;
+
+    // Asynchronous engine, the multi handle is only touched by loopThread_
+    size_t maxConcurrent_;
+    CURLM* multi_;
+    std::thread loopThread_;
+    std::mutex queueMutex_;
+    std::condition_variable idleCv_;
+    std::deque<transfer_t*> queue_;
+    std::vector<transfer_t*> running_;  ///< Added to multi_, loop thread only
+    size_t inFlight_;
+    bool stop_;
+    uint64_t completed_;
+    uint64_t failed_;
+    uint64_t bytesSent_;
+    std::chrono::steady_clock::duration busy_;
+    std::chrono::steady_clock::time_point busySince_;
 };
 
 #endif // HTTP_UPLOADER_H
@@ -10,6 +10,8 @@
 #include <algorithm>
 #include <cstdio>
 #include <cmath>
+#include <stdexcept>
+#include "imghelpers.h"
 
 /**
  * @brief Convert an image to grayscale.
@@ -169,6 +171,233 @@ double calculateBrightness(cv::Mat &img) {
     }
 }
 
+/**
+ * @brief Compute the selected image statistics with one grayscale conversion.
+ *
+ * @param img The input image.
+ * @param mask Bitwise OR of image_stats_mask_e values.
+ * @return image_stats_t The computed statistics.
+ */
+image_stats_t computeImageStats(const cv::Mat &img, StatsMask mask) {
+    image_stats_t stats = {};
+    stats.channels = img.channels();
+
+    if (mask & STATS_CHANNEL_MEANS) {
+        stats.channelMeans = cv::mean(img);
+    }
+    if (!(mask & (STATS_MEAN_STDDEV | STATS_MIN_MAX | STATS_LAPLACIAN))) {
+        return stats;
+    }
+
+    cv::Mat grayscale;
+    if (img.channels() == 3) {
+        cv::cvtColor(img, grayscale, cv::COLOR_BGR2GRAY);
+    } else if (img.channels() == 4) {
+        cv::cvtColor(img, grayscale, cv::COLOR_BGRA2GRAY);
+    } else {
+        grayscale = img;
+    }
+
+    if (grayscale.type() != CV_8UC1) {
+        // Generic path for depths the fused kernel does not handle
+        if (mask & STATS_MEAN_STDDEV) {
+            cv::Scalar mean, sigma;
+            cv::meanStdDev(grayscale, mean, sigma);
+            stats.mean = mean[0];
+            stats.stddev = sigma[0];
+        }
+        if (mask & STATS_MIN_MAX) {
+            cv::minMaxLoc(grayscale, &stats.min, &stats.max);
+        }
+        if (mask & STATS_LAPLACIAN) {
+            cv::Mat laplacian;
+            cv::Scalar mean, sigma;
+            cv::Laplacian(grayscale, laplacian, CV_64F);
+            cv::meanStdDev(laplacian, mean, sigma);
+            stats.laplacianVariance = sigma[0] * sigma[0];
+        }
+        return stats;
+    }
+
+    const int rows = grayscale.rows;
+    const int cols = grayscale.cols;
+    const bool wantLaplacian = (mask & STATS_LAPLACIAN) != 0;
+    uint64_t sum = 0;
+    uint64_t sumSq = 0;
+    int minValue = 255;
+    int maxValue = 0;
+    double lapSum = 0.0;
+    double lapSumSq = 0.0;
+
+    // Reflect-101 border, as used by cv::Laplacian by default
+    auto reflect = [](int i, int n) {
+        if (n == 1) return 0;
+        if (i < 0) return -i;
+        if (i >= n) return 2 * n - 2 - i;
+        return i;
+    };
+
+    for (int r = 0; r < rows; ++r) {
+        const uchar *p = grayscale.ptr<uchar>(r);
+        uint32_t rowSum = 0;
+        uint64_t rowSumSq = 0;
+        for (int c = 0; c < cols; ++c) {
+            const int v = p[c];
+            rowSum += v;
+            rowSumSq += static_cast<uint32_t>(v * v);
+            minValue = std::min(minValue, v);
+            maxValue = std::max(maxValue, v);
+        }
+        sum += rowSum;
+        sumSq += rowSumSq;
+
+        if (wantLaplacian) {
+            // 3x3 aperture: up + down + left + right - 4 * centre
+            const uchar *up = grayscale.ptr<uchar>(reflect(r - 1, rows));
+            const uchar *down = grayscale.ptr<uchar>(reflect(r + 1, rows));
+            int64_t rowLap = 0;
+            int64_t rowLapSq = 0;
+            for (int c = 0; c < cols; ++c) {
+                const int left = p[reflect(c - 1, cols)];
+                const int right = p[reflect(c + 1, cols)];
+                const int lap = up[c] + down[c] + left + right - 4 * p[c];
+                rowLap += lap;
+                rowLapSq += lap * lap;
+            }
+            lapSum += static_cast<double>(rowLap);
+            lapSumSq += static_cast<double>(rowLapSq);
+        }
+    }
+
+    const double count = static_cast<double>(rows) * cols;
+    if (count == 0) {
+        return stats;
+    }
+    if (mask & STATS_MEAN_STDDEV) {
+        stats.mean = sum / count;
+        stats.stddev = std::sqrt(std::max(0.0, sumSq / count - stats.mean * stats.mean));
+    }
+    if (mask & STATS_MIN_MAX) {
+        stats.min = minValue;
+        stats.max = maxValue;
+    }
+    if (wantLaplacian) {
+        const double lapMean = lapSum / count;
+        stats.laplacianVariance = std::max(0.0, lapSumSq / count - lapMean * lapMean);
+    }
+    return stats;
+}
+
+/**
+ * @brief Derive the Signal-to-Noise Ratio from STATS_MEAN_STDDEV statistics.
+ */
+double statsSNR(const image_stats_t &stats) {
+    if (stats.stddev == 0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return 20 * std::log10(stats.mean / stats.stddev);
+}
+
+/**
+ * @brief Derive the contrast from STATS_MIN_MAX statistics.
+ */
+double statsContrast(const image_stats_t &stats) {
+    return (stats.max - stats.min) / stats.max;
+}
+
+/**
+ * @brief Derive the brightness from STATS_CHANNEL_MEANS statistics.
+ */
+double statsBrightness(const image_stats_t &stats) {
+    if (stats.channels == 3) {
+        return stats.channelMeans[0] * 0.299 + stats.channelMeans[1] * 0.587 + stats.channelMeans[2] * 0.114;
+    }
+    return stats.channelMeans[0];
+}
+
+/**
+ * @brief Calculate exact per-channel histograms of an 8-bit image.
+ *
+ * @param img The input image (CV_8U depth, 1 to 4 channels).
+ * @param histograms Output, resized to img.channels() and overwritten.
+ * @return int 0 on success.
+ */
+int calculateChannelHistograms(const cv::Mat &img, std::vector<channelHistogram> &histograms) {
+    if (img.empty()) {
+        throw std::runtime_error("Image is empty.");
+    }
+    const int channels = img.channels();
+    if (img.depth() != CV_8U || channels < 1 || channels > 4) {
+        throw std::runtime_error("Unsupported image type for histogram.");
+    }
+
+    histograms.assign(channels, channelHistogram{});
+
+    // A continuous image is scanned as one long row
+    int rows = img.rows;
+    size_t rowLen = static_cast<size_t>(img.cols) * channels;
+    if (img.isContinuous()) {
+        rowLen *= rows;
+        rows = 1;
+    }
+
+    if (channels == 1) {
+        // Four interleaved sub-histograms break the store-to-load dependency
+        // between neighbouring pixels with the same value
+        std::vector<uint32_t> sub(4 * 256, 0);
+        uint32_t *h0 = sub.data();
+        uint32_t *h1 = h0 + 256;
+        uint32_t *h2 = h1 + 256;
+        uint32_t *h3 = h2 + 256;
+        for (int r = 0; r < rows; ++r) {
+            const uchar *p = img.ptr<uchar>(r);
+            size_t i = 0;
+            for (; i + 4 <= rowLen; i += 4) {
+                ++h0[p[i]];
+                ++h1[p[i + 1]];
+                ++h2[p[i + 2]];
+                ++h3[p[i + 3]];
+            }
+            for (; i < rowLen; ++i) {
+                ++h0[p[i]];
+            }
+        }
+        for (int v = 0; v < 256; ++v) {
+            histograms[0][v] = h0[v] + h1[v] + h2[v] + h3[v];
+        }
+        return 0;
+    }
+
+    for (int r = 0; r < rows; ++r) {
+        const uchar *p = img.ptr<uchar>(r);
+        const uchar *end = p + rowLen;
+        switch (channels) {
+        case 2:
+            for (; p < end; p += 2) {
+                ++histograms[0][p[0]];
+                ++histograms[1][p[1]];
+            }
+            break;
+        case 3:
+            for (; p < end; p += 3) {
+                ++histograms[0][p[0]];
+                ++histograms[1][p[1]];
+                ++histograms[2][p[2]];
+            }
+            break;
+        default:
+            for (; p < end; p += 4) {
+                ++histograms[0][p[0]];
+                ++histograms[1][p[1]];
+                ++histograms[2][p[2]];
+                ++histograms[3][p[3]];
+            }
+            break;
+        }
+    }
+    return 0;
+}
+
 /**
  * @brief Save an image with an incremental name in the specified directory.
  * 
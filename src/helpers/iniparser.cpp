@@ -32,3 +32,18 @@ std::map<std::string, std::string> IniParser::parseIniFile(const std::string& fi
 
         return result;
     }
+
+float IniParser::parseThreshold(const std::string& key, const std::string& value) {
+        size_t consumed = 0;
+        float threshold;
+        try {
+            threshold = std::stof(value, &consumed);
+        } catch (const std::exception& e) {
+            throw std::invalid_argument("invalid threshold for " + key + ": '" + value + "'");
+        }
+        // Allow trailing blanks left by the INI reader, nothing else
+        if (value.find_first_not_of(" \t\r", consumed) != std::string::npos) {
+            throw std::invalid_argument("invalid threshold for " + key + ": '" + value + "'");
+        }
+        return threshold;
+    }
@@ -10,9 +10,13 @@
 #include <aws/s3/S3Client.h>
 #include <aws/s3/model/PutObjectRequest.h>
 #endif
+#include <atomic>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <thread>
+#include "change_tracker.h"
+#include "upload_spool.h"
 
 ImageUploader::ImageUploader(int uploadtype, const std::string& endpointUrl, const std::string& token,
                             s3_client_config_t &s3_client_config):s3_client_config_(s3_client_config), stopFlag_(false){
@@ -44,12 +48,24 @@ bool ImageUploader::startUploadThread(const std::string& imagePath, const std::s
  * @brief Stops the running upload thread
  */
 void ImageUploader::stopUploadThread() {
-  stopFlag_.store(true);
+  {
+    // Not uploadMutex_: the upload thread holds that until its backlog drains
+    std::lock_guard<std::mutex> lock(stopMutex_);
+    stopFlag_.store(true);
+  }
+  stopCv_.notify_all();
 }
 
 /**
  * @brief Function to run the upload thread in a separate thread
- * @param imagePath Path to the image file on local storage
+ *
+ * Over HTTP, every file under imagePath (or imagePath itself when it is a
+ * file) goes through an UploadSpool journaled next to it, so each version of a
+ * file is uploaded once, failures are retried with backoff and the queue
+ * survives a restart. A ChangeTracker hands the spool only new and changed
+ * files, from inotify events where available, so an unchanged folder costs
+ * no reads or uploads. Due uploads run on the uploader's concurrent engine.
+ * @param imagePath Path to the image file or directory on local storage
  * @param bucketName Name of the S3 bucket where the image will be uploaded
  * @param objectKey Name of the object (filename) in the S3 bucket
  * @param interval Upload interval in milliseconds
@@ -64,10 +80,18 @@ void ImageUploader::uploadThread(const std::string& imagePath, const std::string
         s3Client = new Aws::S3::S3Client(credentials_, Aws::Region::fromName(region_.c_str()));
     }
 #endif
-  while (!stopFlag_.load()) {
-    // Acquire lock to ensure thread-safe image upload
-    uploadMutex_.lock();
+  // The tracker skips dot files, so the journal can live inside the folder
+  std::error_code ec;
+  const bool isDirectory = std::filesystem::is_directory(imagePath, ec);
+  UploadSpool spool(isDirectory ? imagePath + "/.upload_spool" : imagePath + ".upload_spool");
+  ChangeTracker tracker(imagePath);
+  if (type != 1 && !spool.open()) {
+    std::cerr << "Upload spool for " << imagePath << " is not persistent." << std::endl;
+  }
 
+  while (!stopFlag_.load()) {
+    std::chrono::milliseconds wait = interval;
+    std::unique_lock<std::mutex> lock(uploadMutex_);
     if (type == 1) {
         // Upload the image
 //TODO: resolve error
@@ -77,11 +101,46 @@ void ImageUploader::uploadThread(const std::string& imagePath, const std::string
         }
 #endif
     } else  {
-        _HttpUploader->postFile(imagePath, bucketName, time(NULL));
+        // New and changed files join the spool, unchanged uploaded ones are not looked at
+        time_t now = time(NULL);
+        for (const changed_file_t& file : tracker.changed()) {
+            spool_entry_t known;
+            if (!spool.enqueue(file.path, bucketName, now) && spool.find(file.path, known) &&
+                known.state == SPOOL_DONE) {
+                // Uploaded before a restart, the index starts out empty
+                tracker.markUploaded(file.path, known.size, known.mtime_ns);
+            }
+        }
+
+        // Queue the whole due backlog at once, the engine keeps several uploads in flight
+        std::atomic<size_t> failed(0);
+        for (const spool_entry_t& entry : spool.due()) {
+            _HttpUploader->postFileAsync(entry.path, entry.sensorId, entry.timestamp,
+                                         [&spool, &tracker, &failed, entry](const upload_result_t& result) {
+                                             if (result.ok) {
+                                                 spool.markDone(entry);
+                                                 tracker.markUploaded(entry.path, entry.size, entry.mtime_ns);
+                                             } else {
+                                                 spool.markFailed(entry);
+                                                 failed++;
+                                             }
+                                         });
+        }
+        _HttpUploader->waitIdle();
+        if (failed.load() > 0) {
+            std::cerr << "Failed to upload " << failed.load() << " files in this iteration, "
+                      << spool.pending() << " pending." << std::endl;
+        }
+        // Come back early when a retry's backoff ends before the interval
+        int64_t retry = spool.nextDueMs();
+        if (retry >= 0 && retry < wait.count()) {
+            wait = std::chrono::milliseconds(retry);
+        }
     }
-    // Release lock and wait for the interval
-    uploadMutex_.unlock();
-    std::this_thread::sleep_for(interval);
+    lock.unlock();
+    // Wait for the interval, or until stopUploadThread()
+    std::unique_lock<std::mutex> stopLock(stopMutex_);
+    stopCv_.wait_for(stopLock, wait, [this] { return stopFlag_.load(); });
   }
 }
 
@@ -0,0 +1,261 @@
+/**
+ * @file samplewriter.cpp
+ * @brief Implements the background sample image writer
+ */
+
+#include "samplewriter.h"
+#include "datatracer_log.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+sample_writer_config_t parseSampleWriterConfig(std::map<std::string, std::string> &config) {
+    sample_writer_config_t result;
+    result.queue_size = 64;
+    result.codec = SAMPLE_CODEC_PNG;
+    result.drop_policy = SAMPLE_DROP_NEWEST;
+    result.jpeg_quality = 95;
+
+    auto it = config.find("sample_codec");
+    if (it != config.end()) {
+        if (it->second == "jpeg" || it->second == "jpg") {
+            result.codec = SAMPLE_CODEC_JPEG;
+        } else if (it->second == "raw") {
+            result.codec = SAMPLE_CODEC_RAW;
+        } else if (it->second != "png") {
+            log_err << "unknown sample_codec " << it->second << ", using png" << std::endl;
+        }
+        config.erase(it);
+    }
+    it = config.find("sample_drop_policy");
+    if (it != config.end()) {
+        if (it->second == "oldest") {
+            result.drop_policy = SAMPLE_DROP_OLDEST;
+        } else if (it->second != "newest") {
+            log_err << "unknown sample_drop_policy " << it->second << ", using newest" << std::endl;
+        }
+        config.erase(it);
+    }
+    it = config.find("sample_queue_size");
+    if (it != config.end()) {
+        try {
+            result.queue_size = std::stoul(it->second);
+        } catch (const std::exception& e) {
+            log_err << "invalid sample_queue_size " << it->second << std::endl;
+        }
+        config.erase(it);
+    }
+    it = config.find("sample_jpeg_quality");
+    if (it != config.end()) {
+        try {
+            result.jpeg_quality = std::stoi(it->second);
+        } catch (const std::exception& e) {
+            log_err << "invalid sample_jpeg_quality " << it->second << std::endl;
+        }
+        config.erase(it);
+    }
+    return result;
+}
+
+SampleWriter::SampleWriter(const sample_writer_config_t &config)
+    : config_(config), queue_(config.queue_size), exit_(false), sleeping_(false),
+      written_(0), dropped_(0), failed_(0) {
+    write_thread_ = std::thread(&SampleWriter::writeLoop, this);
+}
+
+SampleWriter::~SampleWriter() {
+    stop();
+}
+
+bool SampleWriter::enqueue(const cv::Mat &img, const std::string &path, const std::string &baseName) {
+    sample_item_t item;
+    img.copyTo(item.img);
+    item.path = path;
+    item.baseName = baseName;
+    item.timestamp = time(NULL);
+    return push(item);
+}
+
+bool SampleWriter::enqueue(const cv::Mat &img, const std::string &path,
+                           const std::vector<sample_reason_t> &reasons) {
+    if (reasons.empty()) {
+        return false;
+    }
+    sample_item_t item;
+    img.copyTo(item.img);
+    item.path = path;
+    item.baseName = reasons[0].metric;
+    item.reasons = reasons;
+    item.timestamp = time(NULL);
+    return push(item);
+}
+
+bool SampleWriter::push(sample_item_t &item) {
+    bool queued = queue_.push(std::move(item));
+    if (!queued && config_.drop_policy == SAMPLE_DROP_OLDEST) {
+        sample_item_t oldest;
+        // Bounded retries: other producers may refill the freed slot first
+        for (int i = 0; i < 4 && !queued; ++i) {
+            if (queue_.pop(oldest)) {
+                dropped_++;
+            }
+            queued = queue_.push(std::move(item));
+        }
+    }
+    if (!queued) {
+        dropped_++;
+        return false;
+    }
+    wakeWriter();
+    return true;
+}
+
+void SampleWriter::wakeWriter() {
+    // Only take the mutex when the writer may be waiting on the condition variable
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_.load()) {
+        std::lock_guard<std::mutex> lock(wait_mutex_);
+        cv_.notify_one();
+    }
+}
+
+void SampleWriter::stop() {
+    if (write_thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(wait_mutex_);
+            exit_.store(true);
+        }
+        cv_.notify_one();
+        write_thread_.join();
+    }
+}
+
+void SampleWriter::writeLoop() {
+    sample_item_t item;
+    while (true) {
+        if (queue_.pop(item)) {
+            writeSample(item);
+            continue;
+        }
+        if (exit_.load() && queue_.empty()) {
+            break;
+        }
+        std::unique_lock<std::mutex> lock(wait_mutex_);
+        sleeping_.store(true);
+        cv_.wait(lock, [&] { return !queue_.empty() || exit_.load(); });
+        sleeping_.store(false);
+    }
+    log_debug << "sample writer thread exited" << std::endl;
+}
+
+int SampleWriter::nextIndex(const std::string &path, const std::string &baseName) {
+    const std::string key = path + "/" + baseName;
+    auto it = indices_.find(key);
+    if (it == indices_.end()) {
+        // First sample for this name: continue after files from earlier runs
+        int highestIndex = 0;
+        DIR *dir = opendir(path.c_str());
+        if (dir) {
+            dirent *entry;
+            while ((entry = readdir(dir)) != NULL) {
+                if (strncmp(entry->d_name, baseName.c_str(), baseName.length()) == 0) {
+                    const char *digits = entry->d_name + baseName.length();
+                    char *end = nullptr;
+                    long index = strtol(digits, &end, 10);
+                    if (end != digits) {
+                        highestIndex = std::max(highestIndex, static_cast<int>(index));
+                    }
+                }
+            }
+            closedir(dir);
+        }
+        it = indices_.emplace(key, highestIndex).first;
+    }
+    return ++(it->second);
+}
+
+void SampleWriter::writeSample(sample_item_t &item) {
+    struct stat st;
+    if (stat(item.path.c_str(), &st) != 0) {
+        if (mkdir(item.path.c_str(), S_IRWXU | S_IRWXG | S_IRWXO) == -1) {
+            log_err << "error creating directory " << item.path << ": " << strerror(errno) << std::endl;
+            failed_++;
+            item.img.release();
+            return;
+        }
+    }
+
+    std::stringstream ss;
+    ss << item.path << "/" << item.baseName << std::setfill('0') << std::setw(4)
+       << nextIndex(item.path, item.baseName);
+
+    bool ok = false;
+    try {
+        switch (config_.codec) {
+            case SAMPLE_CODEC_JPEG: {
+                ss << ".jpg";
+                std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, config_.jpeg_quality};
+                ok = cv::imwrite(ss.str(), item.img, params);
+                break;
+            }
+            case SAMPLE_CODEC_RAW: {
+                // rows, cols and OpenCV type as int32 followed by the packed pixel rows
+                ss << ".raw";
+                std::ofstream os(ss.str(), std::ios::binary | std::ios::trunc);
+                int32_t header[3] = {item.img.rows, item.img.cols, item.img.type()};
+                os.write(reinterpret_cast<const char *>(header), sizeof(header));
+                const size_t rowBytes = item.img.cols * item.img.elemSize();
+                for (int r = 0; r < item.img.rows; ++r) {
+                    os.write(reinterpret_cast<const char *>(item.img.ptr(r)), rowBytes);
+                }
+                os.close();
+                ok = !os.fail();
+                break;
+            }
+            default:
+                ss << ".png";
+                ok = cv::imwrite(ss.str(), item.img);
+                break;
+        }
+        if (!ok) {
+            log_err << "error writing sample " << ss.str() << std::endl;
+        }
+    } catch (const std::exception& e) {
+        log_err << "error writing sample " << ss.str() << ": " << e.what() << std::endl;
+        ok = false;
+    }
+    if (ok) {
+        written_++;
+        // A failed write gets no manifest line, so the manifest only lists files that exist
+        if (!item.reasons.empty()) {
+            appendManifest(item, ss.str());
+        }
+    } else {
+        failed_++;
+    }
+    item.img.release();
+}
+
+void SampleWriter::appendManifest(const sample_item_t &item, const std::string &filename) {
+    std::ofstream os(item.path + "/manifest.csv", std::ios::app);
+    if (!os.is_open()) {
+        log_err << "error opening manifest in " << item.path << std::endl;
+        return;
+    }
+    os << filename.substr(filename.find_last_of('/') + 1) << "," << item.timestamp << ",";
+    for (size_t i = 0; i < item.reasons.size(); ++i) {
+        if (i > 0) {
+            os << ";";
+        }
+        os << item.reasons[i].metric << "=" << item.reasons[i].score << "/" << item.reasons[i].threshold;
+    }
+    os << "\n";
+}
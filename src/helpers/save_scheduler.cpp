@@ -0,0 +1,184 @@
+#include "save_scheduler.h"
+#include <iterator>
+#include <map>
+#include <vector>
+#include "datatracer_log.h"
+#include "saver.h"
+#include "thread_pool.h"
+
+SaveScheduler &SaveScheduler::instance() {
+    static SaveScheduler scheduler;
+    return scheduler;
+}
+
+SaveScheduler::SaveScheduler() : stop_(false) {
+}
+
+SaveScheduler::~SaveScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_cv_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+std::list<SaveScheduler::schedule_entry_t>::iterator SaveScheduler::Find(Saver *saver) {
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->saver == saver) {
+            return it;
+        }
+    }
+    return entries_.end();
+}
+
+void SaveScheduler::add(Saver *saver) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (Find(saver) != entries_.end()) {
+        return;
+    }
+    schedule_entry_t entry;
+    entry.saver = saver;
+    entry.deadline = std::chrono::steady_clock::now();
+    entry.requested = true;
+    entry.running = false;
+    entry.completed = 0;
+    entries_.push_back(entry);
+    if (!thread_.joinable()) {
+        thread_ = std::thread(&SaveScheduler::ScheduleLoop, this);
+    }
+    wake_cv_.notify_one();
+}
+
+void SaveScheduler::remove(Saver *saver) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = Find(saver);
+    if (it == entries_.end()) {
+        return;
+    }
+    done_cv_.wait(lock, [&] { return !it->running; });
+    entries_.erase(it);
+}
+
+void SaveScheduler::trigger(Saver *saver) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = Find(saver);
+    if (it != entries_.end()) {
+        it->requested = true;
+        wake_cv_.notify_one();
+    }
+}
+
+void SaveScheduler::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // A cycle already running may have snapshotted before the caller's updates, so it does not count
+    std::map<Saver *, uint64_t> targets;
+    for (auto &entry : entries_) {
+        entry.requested = true;
+        targets[entry.saver] = entry.completed + (entry.running ? 2 : 1);
+    }
+    wake_cv_.notify_one();
+    done_cv_.wait(lock, [&] {
+        for (const auto &target : targets) {
+            auto it = Find(target.first);
+            if (it != entries_.end() && it->completed < target.second) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+void SaveScheduler::setWorkers(size_t workers) {
+    std::shared_ptr<ThreadPool> pool;
+    if (workers > 1) {
+        pool = std::make_shared<ThreadPool>(workers);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    pool_.swap(pool);
+}
+
+size_t SaveScheduler::registered() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+// Next multiple of the interval on the steady clock, shared by every saver with that interval
+static std::chrono::steady_clock::time_point alignedDeadline(std::chrono::steady_clock::time_point now,
+                                                            std::chrono::milliseconds interval) {
+    if (interval.count() <= 0) {
+        return now;
+    }
+    auto since = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch());
+    return std::chrono::steady_clock::time_point((since / interval + 1) * interval);
+}
+
+void SaveScheduler::ScheduleLoop() {
+    std::vector<std::list<schedule_entry_t>::iterator> due;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point next = std::chrono::steady_clock::time_point::max();
+        due.clear();
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->requested || it->deadline <= now) {
+                due.push_back(it);
+            } else if (it->deadline < next) {
+                next = it->deadline;
+            }
+        }
+        if (due.empty()) {
+            if (next == std::chrono::steady_clock::time_point::max()) {
+                wake_cv_.wait(lock);
+            } else {
+                wake_cv_.wait_until(lock, next);
+            }
+            continue;
+        }
+
+        for (auto it : due) {
+            it->requested = false;
+            it->running = true;
+        }
+        std::shared_ptr<ThreadPool> pool = pool_;
+        lock.unlock();
+        // Every saver of the batch writes its files first...
+        std::vector<std::vector<Saver::pending_write_t>> writes(due.size());
+        if (pool && due.size() > 1) {
+            try {
+                pool->parallelFor(due.size(), [&due, &writes](size_t i) { due[i]->saver->RunCycle(writes[i]); });
+            } catch (const std::exception& e) {
+                log_err << "save cycle failed: " << e.what() << std::endl;
+            }
+        } else {
+            for (size_t i = 0; i < due.size(); i++) {
+                try {
+                    due[i]->saver->RunCycle(writes[i]);
+                } catch (const std::exception& e) {
+                    log_err << due[i]->saver->parent_name << ": save cycle failed: " << e.what() << std::endl;
+                }
+            }
+        }
+        // ...then one sync, rename and directory fsync pass covers all of them, opening one file at a time
+        std::vector<Saver::pending_write_t> batch;
+        for (auto &saver_writes : writes) {
+            std::move(saver_writes.begin(), saver_writes.end(), std::back_inserter(batch));
+        }
+        try {
+            Saver::CommitWrites(batch);
+        } catch (const std::exception& e) {
+            log_err << "save commit failed: " << e.what() << std::endl;
+        }
+        lock.lock();
+
+        now = std::chrono::steady_clock::now();
+        for (auto it : due) {
+            it->running = false;
+            it->completed++;
+            it->deadline = alignedDeadline(now, it->saver->GetInterval());
+        }
+        done_cv_.notify_all();
+    }
+}
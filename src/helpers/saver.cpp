@@ -1,115 +1,665 @@
 #include "saver.h"
 #include <fstream>
+#include <iterator>
+#include <set>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "datatracer_log.h"
-
-#include <kll_sketch.hpp>
-#include <frequent_items_sketch.hpp>
+#include "sketch_container.h"
 
 typedef datasketches::kll_sketch<float> distributionBox;
 typedef datasketches::frequent_items_sketch<std::string> frequent_class_sketch;
 Saver::~Saver(){
+    // Unregister first, a cycle may be serializing one of the objects
+    StopSaving();
     {
         std::unique_lock<std::mutex> lock(queue_mutex_);
         while (!(objects_to_save_.empty())) {
           data_object_t *object = objects_to_save_.front();
           objects_to_save_.pop();
+          delete object->obj;
           delete object;
         }
     }
-    StopSaving();
 }
-Saver::Saver(int interval, std::string class_name) {
-    save_interval_ = interval;
+Saver::Saver(int interval, std::string class_name)
+    : Saver(interval, class_name, defaultSaverConfig()) {
+}
+
+Saver::Saver(int interval, std::string class_name, const saver_config_t &config)
+    : Saver(std::chrono::milliseconds(static_cast<int64_t>(interval) * 1000), class_name, config) {
+}
+
+Saver::Saver(std::chrono::milliseconds interval, std::string class_name, const saver_config_t &config) {
+    save_interval_ = config.interval_ms > 0 ? std::chrono::milliseconds(config.interval_ms) : interval;
     parent_name = class_name;
-    exitSaveLoop.store(false);
+    config_ = config;
+    last_cycle_bytes_.store(0);
+    total_bytes_.store(0);
+    skipped_.store(0);
+    saving_.store(false);
+}
+
+// Footer appended to every saved object: CRC-32 of the payload, then a magic tag
+static const char kFooterMagic[4] = {'D', 'T', 'S', '1'};
+static const size_t kFooterSize = 8;
+
+static void storeLE(uint8_t *dst, uint64_t value, int size) {
+    for (int i = 0; i < size; i++) {
+        dst[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+// Writes the footer right after a payload of the given size
+static void writeFooter(uint8_t *payload, size_t size) {
+    storeLE(payload + size, sketchChecksum(payload, size), 4);
+    memcpy(payload + size + 4, kFooterMagic, sizeof(kFooterMagic));
+}
+
+saver_config_t defaultSaverConfig() {
+    saver_config_t config;
+    config.sync_policy = SAVER_SYNC_CYCLE;
+    config.mode = SAVER_MODE_SNAPSHOT;
+    config.segment_bytes = 4 * 1024 * 1024;
+    config.segment_seconds = 3600;
+    config.interval_ms = 0;
+    return config;
+}
+
+saver_config_t parseSaverConfig(std::map<std::string, std::string> &config) {
+    saver_config_t result = defaultSaverConfig();
+    auto it = config.find("save_sync");
+    if (it != config.end()) {
+        if (it->second == "none") {
+            result.sync_policy = SAVER_SYNC_NONE;
+        } else if (it->second == "cycle") {
+            result.sync_policy = SAVER_SYNC_CYCLE;
+        } else if (it->second == "file") {
+            result.sync_policy = SAVER_SYNC_FILE;
+        } else {
+            log_err << "unknown save_sync " << it->second << ", using cycle" << std::endl;
+        }
+        config.erase(it);
+    }
+    it = config.find("save_mode");
+    if (it != config.end()) {
+        if (it->second == "snapshot") {
+            result.mode = SAVER_MODE_SNAPSHOT;
+        } else if (it->second == "log") {
+            result.mode = SAVER_MODE_LOG;
+        } else if (it->second == "container") {
+            result.mode = SAVER_MODE_CONTAINER;
+        } else {
+            log_err << "unknown save_mode " << it->second << ", using snapshot" << std::endl;
+        }
+        config.erase(it);
+    }
+    it = config.find("save_container");
+    if (it != config.end()) {
+        result.container_path = it->second;
+        config.erase(it);
+    }
+    it = config.find("save_interval_ms");
+    if (it != config.end()) {
+        try {
+            result.interval_ms = std::stoll(it->second);
+        } catch (const std::exception& e) {
+            log_err << "invalid save_interval_ms " << it->second << std::endl;
+        }
+        config.erase(it);
+    }
+    it = config.find("log_segment_bytes");
+    if (it != config.end()) {
+        try {
+            result.segment_bytes = std::stoull(it->second);
+        } catch (const std::exception& e) {
+            log_err << "invalid log_segment_bytes " << it->second << std::endl;
+        }
+        config.erase(it);
+    }
+    it = config.find("log_segment_seconds");
+    if (it != config.end()) {
+        try {
+            result.segment_seconds = std::stoll(it->second);
+        } catch (const std::exception& e) {
+            log_err << "invalid log_segment_seconds " << it->second << std::endl;
+        }
+        config.erase(it);
+    }
+    return result;
+}
+
+bool readSavedObject(const std::string &filename, std::vector<uint8_t> &payload) {
+    std::ifstream is(filename, std::ios::binary);
+    if (!is) {
+        return false;
+    }
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    if (bytes.size() < kFooterSize ||
+        memcmp(bytes.data() + bytes.size() - 4, kFooterMagic, sizeof(kFooterMagic)) != 0) {
+        return false;
+    }
+    const size_t size = bytes.size() - kFooterSize;
+    uint32_t stored = 0;
+    for (int i = 0; i < 4; i++) {
+        stored |= static_cast<uint32_t>(bytes[size + i]) << (8 * i);
+    }
+    if (stored != sketchChecksum(bytes.data(), size)) {
+        return false;
+    }
+    bytes.resize(size);
+    payload.swap(bytes);
+    return true;
 }
 
 void Saver::AddObjectToSave(void *object, int type, const std::string& filename) {
+  // The only place the type tag is trusted; the save loop works on ISerializable
+  switch(type) {
+    case KLL_TYPE:
+      AddObjectToSave((distributionBox *)object, filename);
+      break;
+    case FI_TYPE:
+      AddObjectToSave((frequent_class_sketch *)object, filename);
+      break;
+    case SHARDED_KLL_TYPE:
+      AddObjectToSave((ShardedSketch<distributionBox> *)object, filename);
+      break;
+    case SHARDED_FI_TYPE:
+      AddObjectToSave((ShardedSketch<frequent_class_sketch> *)object, filename);
+      break;
+    default:
+      log_err << parent_name << ": unknown object type " << type << " for " << filename << std::endl;
+      break;
+  }
+}
+
+// Container index key of an object: the base name of its file
+static std::string containerEntryName(const std::string &filename) {
+  const size_t slash = filename.find_last_of('/');
+  return slash == std::string::npos ? filename : filename.substr(slash + 1);
+}
+
+void Saver::AddSerializable(ISerializable *object, int type, const std::string& filename) {
   std::lock_guard<std::mutex> lock(queue_mutex_);
+  if (config_.mode == SAVER_MODE_CONTAINER && !container_names_.insert(containerEntryName(filename)).second) {
+    // find() could not tell the two entries apart
+    log_err << parent_name << ": " << filename << " has the same container name as an object already added, skipped"
+            << std::endl;
+    delete object;
+    return;
+  }
+  const bool first = objects_to_save_.empty();
   data_object_t *tmp_obj = new data_object_t;
   tmp_obj->obj = object;
   tmp_obj->type = type;
   tmp_obj->filename = filename;
+  tmp_obj->saved_generation = ISerializable::kAlwaysDirty;  // Never written
+  tmp_obj->segment_start = 0;
+  tmp_obj->segment_bytes = 0;
+  tmp_obj->window_start = time(nullptr);
   objects_to_save_.push(tmp_obj);
-  cv_.notify_one(); // Notify the waiting thread about a new object
+  if (first && saving_.load()) {
+    // Do not wait a whole interval for the first object
+    SaveScheduler::instance().trigger(this);
+  }
   log_info << parent_name << ": added " << filename << " into saver" << std::endl;
 }
 
 void Saver::StartSaving() {
-  save_thread_ = std::thread(&Saver::SaveLoop, this);
-  log_debug << parent_name << ": saver thread started" << std::endl;
+  saving_.store(true);
+  SaveScheduler::instance().add(this);
+  log_debug << parent_name << ": registered with the save scheduler" << std::endl;
 }
 
 // Trigger method is to asynchronously trigger the object save
 void Saver::TriggerSave() {
-  std::lock_guard<std::mutex> lock(queue_mutex_);
-  cv_.notify_one(); // Notify the waiting thread to process the queue manually
-  log_debug << parent_name << ": save notification sent to saver thread" << std::endl;
+  SaveScheduler::instance().trigger(this);
+  log_debug << parent_name << ": save requested from the save scheduler" << std::endl;
 }
 
-void Saver::SaveLoop() {
-  while (true) {
-    do {
+void Saver::RunCycle(std::vector<pending_write_t> &pending) {
+  // CommitWrites adds the bytes of this cycle once they are renamed
+  last_cycle_bytes_.store(0);
+  std::queue<data_object_t *> cycle;
+  {
+    // Only the list of objects is copied under the lock; snapshots and file I/O
+    // run without it so AddObjectToSave() never waits on disk
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    cycle = objects_to_save_;
+  }
+  if (cycle.empty()) {
+    return;
+  }
+  if (config_.mode == SAVER_MODE_CONTAINER) {
+    SaveContainer(cycle, pending);
+  } else {
+    SaveFiles(cycle, pending);
+  }
+}
 
-    if (exitSaveLoop.load()) {
-      log_debug << parent_name << ": exited from saver thread" << std::endl;
-      pthread_exit(nullptr);// Thread termination condition
+// Log record: "DTL1", payload size, window start, window end (little endian),
+// payload, then CRC-32 of everything before it
+static const char kRecordMagic[4] = {'D', 'T', 'L', '1'};
+static const size_t kRecordHeaderSize = 24;
+
+static uint64_t getLE(const uint8_t *bytes, int size) {
+    uint64_t value = 0;
+    for (int i = 0; i < size; i++) {
+        value |= static_cast<uint64_t>(bytes[i]) << (8 * i);
     }
+    return value;
+}
 
-    std::unique_lock<std::mutex> lock(queue_mutex_);
-    cv_.wait(lock, [&] { return !objects_to_save_.empty() || exitSaveLoop.load();}); // Wait for a new object or thread termination
+static bool writeAll(int fd, const uint8_t *bytes, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = write(fd, bytes + done, size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
 
-    if (exitSaveLoop.load()) {
-      log_debug << parent_name << ": exited from saver thread" << std::endl;
-      pthread_exit(nullptr);// Thread termination condition
+static std::string parentDirectory(const std::string &filename) {
+    size_t slash = filename.find_last_of('/');
+    if (slash == std::string::npos) {
+        return ".";
     }
+    return slash == 0 ? "/" : filename.substr(0, slash);
+}
 
-    data_object_t *start_object = objects_to_save_.front();
-    // Save only the first object in the queue and overwrite in the file
-    do{
-      data_object_t *object = objects_to_save_.front();
-      SaveObjectToFile(object);
+// Flushes the data of one file; false if the kernel reported a write-back error
+static bool syncData(int fd) {
+#ifdef __APPLE__
+    return fsync(fd) == 0;
+#else
+    return fdatasync(fd) == 0;
+#endif
+}
 
-      // Rotate the queue by one element (circular approach)
-      objects_to_save_.push(objects_to_save_.front());
-      objects_to_save_.pop();
-    }while(start_object != objects_to_save_.front());
+void Saver::SaveFiles(std::queue<data_object_t *> &cycle, std::vector<pending_write_t> &pending) {
+    const time_t now = time(nullptr);
+    uint64_t skipped = 0;
 
-    }while(0); //scope of queue_mutex_
-    for (int i = 0; i < save_interval_; i++) {
-        if (exitSaveLoop.load()) {
-            log_debug << parent_name << ": exited from saver thread" << std::endl;
-            pthread_exit(nullptr);// Thread termination condition
+    // Freeze every changed object and size the whole cycle, so the arena is
+    // resized at most once and each object serializes straight into its slice
+    items_.clear();
+    size_t total = 0;
+    while (!cycle.empty()) {
+      data_object_t *object = cycle.front();
+      cycle.pop();
+      cycle_item_t item;
+      item.object = object;
+      // Read before prepare(): an update racing with it only causes one extra rewrite
+      item.generation = object->obj->generation();
+      if (item.generation != ISerializable::kAlwaysDirty && item.generation == object->saved_generation) {
+        skipped++;
+        continue;
+      }
+      item.log = config_.mode == SAVER_MODE_LOG && object->obj->supports_drain();
+      try {
+        if (!object->obj->prepare(item.log)) {
+          // The updates counted by the generation were already in the previous delta
+          object->obj->release(true);
+          object->saved_generation = item.generation;
+          continue;
         }
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        item.size = object->obj->serialized_size() + (item.log ? kRecordHeaderSize + 4 : kFooterSize);
+      } catch (const std::exception& e) {
+        log_err << parent_name << " : Error saving file: " << e.what() << std::endl;
+        object->obj->release(false);
+        continue;
+      }
+      item.offset = total;
+      total += item.size;
+      items_.push_back(item);
     }
-  }
+    if (arena_.size() < total) {
+      arena_.resize(total);
+    }
+
+    pending.reserve(pending.size() + items_.size());
+    for (const cycle_item_t &item : items_) {
+      data_object_t *object = item.object;
+      uint8_t *slice = arena_.data() + item.offset;
+      const size_t head = item.log ? kRecordHeaderSize : 0;
+      const size_t expected = item.size - (item.log ? kRecordHeaderSize + 4 : kFooterSize);
+      size_t written = 0;
+      try {
+        written = object->obj->serialize_into(slice + head, expected);
+      } catch (const std::exception& e) {
+        log_err << parent_name << " : Error saving file: " << e.what() << std::endl;
+        object->obj->release(false);
+        continue;
+      }
+      if (written != expected) {
+        log_err << parent_name << " : " << object->filename << " serialized " << written
+                << " bytes, expected " << expected << std::endl;
+        object->obj->release(false);
+        continue;
+      }
+
+      pending_write_t write;
+      write.saver = this;
+      write.objects.push_back({object, item.generation});
+      bool ok;
+      if (item.log) {
+        memcpy(slice, kRecordMagic, sizeof(kRecordMagic));
+        storeLE(slice + 4, expected, 4);
+        storeLE(slice + 8, static_cast<uint64_t>(object->window_start), 8);
+        storeLE(slice + 16, static_cast<uint64_t>(now), 8);
+        storeLE(slice + head + expected, sketchChecksum(slice, head + expected), 4);
+        ok = AppendLogRecord(object, slice, item.size, now, write);
+      } else {
+        writeFooter(slice, expected);
+        ok = WriteTempFile(object->filename, slice, item.size, write);
+      }
+      object->obj->release(ok);
+      if (ok) {
+        pending.push_back(std::move(write));
+      }
+    }
+    skipped_ += skipped;
 }
 
-void Saver::SaveObjectToFile(data_object_t *object) {
-    std::ofstream os(object->filename.c_str());
-    try {
-    switch(object->type) {
-        case KLL_TYPE:{
-            distributionBox *obj = (distributionBox *)(object->obj);
-            obj->serialize(os);
-            break;
+void Saver::SaveContainer(std::queue<data_object_t *> &cycle, std::vector<pending_write_t> &pending) {
+    if (cycle.empty()) {
+      return;
+    }
+    std::vector<data_object_t *> objects;
+    std::vector<uint64_t> generations;
+    bool changed = false;
+    while (!cycle.empty()) {
+      data_object_t *object = cycle.front();
+      cycle.pop();
+      uint64_t generation = object->obj->generation();
+      // Unchanged objects reuse the bytes serialized for the previous container
+      if (generation == ISerializable::kAlwaysDirty || generation != object->saved_generation ||
+          object->cached.empty()) {
+        try {
+          object->obj->prepare(false);
+          object->cached.resize(object->obj->serialized_size());
+          const size_t written = object->obj->serialize_into(object->cached.data(), object->cached.size());
+          // The bytes are in cached now, the frozen copy is not needed until the next change
+          object->obj->release(written == object->cached.size());
+          if (written != object->cached.size()) {
+            log_err << parent_name << " : " << object->filename << " serialized a different size" << std::endl;
+            object->cached.clear();
+            continue;
+          }
+        } catch (const std::exception& e) {
+          log_err << parent_name << " : Error saving file: " << e.what() << std::endl;
+          object->obj->release(false);
+          object->cached.clear();
+          continue;
         }
-        case FI_TYPE:{
-            frequent_class_sketch *obj = (frequent_class_sketch *)(object->obj);
-            obj->serialize(os);
-            break;
+        changed = true;
+      }
+      objects.push_back(object);
+      generations.push_back(generation);
+    }
+    if (!changed) {
+      skipped_ += objects.size();
+      return;
+    }
+
+    std::vector<sketch_container_entry_t> entries;
+    entries.reserve(objects.size());
+    for (data_object_t *object : objects) {
+      entries.push_back({containerEntryName(object->filename), object->type, object->cached.data(),
+                         object->cached.size()});
+    }
+    encodeSketchContainer(entries, arena_);
+
+    std::string path = config_.container_path;
+    if (path.empty()) {
+      path = parentDirectory(objects.front()->filename) + "/" + parent_name + ".dtc";
+    }
+    pending_write_t write;
+    write.saver = this;
+    for (size_t i = 0; i < objects.size(); i++) {
+      write.objects.push_back({objects[i], generations[i]});
+    }
+    if (WriteTempFile(path, arena_.data(), arena_.size(), write)) {
+      pending.push_back(std::move(write));
+    }
+}
+
+bool Saver::WriteTempFile(const std::string &filename, const uint8_t *bytes, size_t size, pending_write_t &pending) {
+    pending.filename = filename;
+    pending.tmpname = filename + ".tmp";
+    pending.bytes = size;
+    pending.sync = false;
+    int fd = open(pending.tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        log_err << parent_name << " : Error opening " << pending.tmpname << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (!writeAll(fd, bytes, size)) {
+        log_err << parent_name << " : Error writing " << pending.tmpname << ": " << strerror(errno) << std::endl;
+        close(fd);
+        unlink(pending.tmpname.c_str());
+        return false;
+    }
+    if (config_.sync_policy == SAVER_SYNC_FILE && !syncData(fd)) {
+        log_err << parent_name << " : Error syncing " << pending.tmpname << ": " << strerror(errno) << std::endl;
+        close(fd);
+        unlink(pending.tmpname.c_str());
+        return false;
+    }
+    closeForSync(fd, pending);
+    return true;
+}
+
+void Saver::closeForSync(int fd, pending_write_t &pending) {
+    if (config_.sync_policy == SAVER_SYNC_CYCLE) {
+#ifdef __linux__
+        // Start write-back now so the fdatasync() in CommitWrites mostly waits on I/O already in flight;
+        // a failure here only loses the head start, that fdatasync() reports real errors
+        sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+        pending.sync = true;
+    }
+    // Not kept open: a cycle can write more files than the process may hold descriptors
+    close(fd);
+}
+
+bool Saver::AppendLogRecord(data_object_t *object, const uint8_t *record, size_t size, time_t now,
+                            pending_write_t &pending) {
+    if (object->segment.empty() || object->segment_bytes >= config_.segment_bytes ||
+        now - object->segment_start >= config_.segment_seconds) {
+        object->segment = object->filename + "." + std::to_string(static_cast<long long>(now)) + ".log";
+        object->segment_start = now;
+        object->segment_bytes = 0;
+    }
+    pending.filename = object->segment;
+    pending.tmpname.clear();
+    pending.bytes = size;
+    pending.sync = false;
+    int fd = open(object->segment.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        log_err << parent_name << " : Error opening " << object->segment << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    // Where this record starts, so a failed append can be cut off again
+    const off_t start = lseek(fd, 0, SEEK_END);
+    bool ok = writeAll(fd, record, size);
+    if (!ok) {
+        log_err << parent_name << " : Error writing " << object->segment << ": " << strerror(errno) << std::endl;
+    } else if (config_.sync_policy == SAVER_SYNC_FILE && !syncData(fd)) {
+        log_err << parent_name << " : Error syncing " << object->segment << ": " << strerror(errno) << std::endl;
+        ok = false;
+    }
+    if (!ok) {
+        // readSketchLog stops at the first bad record, so a torn one would hide every later append
+        if (start < 0 || ftruncate(fd, start) != 0) {
+            log_err << parent_name << " : Error truncating " << object->segment << ": " << strerror(errno)
+                    << ", starting a new segment" << std::endl;
+            object->segment.clear();
         }
+        close(fd);
+        return false;
     }
-    } catch (const std::exception& e) {
-            log_err << parent_name << " : Error saving file: " << e.what() << std::endl;
+    closeForSync(fd, pending);
+    object->segment_bytes += size;
+    // Only now is the delta in the log; after a failure the window keeps its start
+    object->window_start = now;
+    return true;
+}
+
+size_t readSketchLog(const std::string &filename, time_t from, time_t to,
+                     std::vector<sketch_log_record_t> &records) {
+    const std::string dir = parentDirectory(filename);
+    const size_t slash = filename.find_last_of('/');
+    const std::string prefix = (slash == std::string::npos ? filename : filename.substr(slash + 1)) + ".";
+    const std::string suffix = ".log";
+
+    std::vector<std::pair<long long, std::string>> segments;
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr) {
+        return 0;
+    }
+    while (struct dirent *entry = readdir(d)) {
+        std::string name = entry->d_name;
+        if (name.size() <= prefix.size() + suffix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            continue;
+        }
+        std::string stamp = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+        if (stamp.empty() || stamp.find_first_not_of("0123456789") != std::string::npos) {
+            continue;
+        }
+        segments.push_back({std::stoll(stamp), dir + "/" + name});
+    }
+    closedir(d);
+    std::sort(segments.begin(), segments.end());
+
+    size_t count = 0;
+    for (const auto& segment : segments) {
+        if (segment.first > to) {
+            break;  // Every record of this and later segments starts after the range
+        }
+        std::ifstream is(segment.second, std::ios::binary);
+        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+        size_t pos = 0;
+        while (pos + kRecordHeaderSize <= bytes.size()) {
+            const uint8_t *header = bytes.data() + pos;
+            if (memcmp(header, kRecordMagic, sizeof(kRecordMagic)) != 0) {
+                log_err << "corrupt record in " << segment.second << " at " << pos << std::endl;
+                break;
+            }
+            const size_t size = getLE(header + 4, 4);
+            if (pos + kRecordHeaderSize + size + 4 > bytes.size()) {
+                break;  // Torn tail of an interrupted append
+            }
+            const size_t body = kRecordHeaderSize + size;
+            if (getLE(header + body, 4) != sketchChecksum(header, body)) {
+                log_err << "checksum mismatch in " << segment.second << " at " << pos << std::endl;
+                break;
+            }
+            sketch_log_record_t record;
+            record.start = static_cast<time_t>(getLE(header + 8, 8));
+            record.end = static_cast<time_t>(getLE(header + 16, 8));
+            if (record.end >= from && record.start <= to) {
+                record.payload.assign(header + kRecordHeaderSize, header + body);
+                records.push_back(std::move(record));
+                count++;
+            }
+            pos += body + 4;
+        }
+    }
+    return count;
+}
+
+size_t Saver::CommitWrites(std::vector<pending_write_t> &pending) {
+    if (pending.empty()) {
+        return 0;
+    }
+    // Directories of every saver in the batch are fsynced once, after all renames
+    std::set<std::string> directories;
+    for (const auto& write : pending) {
+        if (write.saver->config_.sync_policy != SAVER_SYNC_NONE) {
+            directories.insert(parentDirectory(write.filename));
+        }
+    }
+
+    // Every file of the batch was written before the first of these waits, so
+    // their write-back overlaps; only the files of this batch are flushed, one
+    // fdatasync() each, reopened by name so a single descriptor is open at a time
+    std::vector<bool> synced(pending.size(), true);
+    for (size_t i = 0; i < pending.size(); i++) {
+        if (!pending[i].sync) {
+            continue;
+        }
+        const std::string &path = pending[i].tmpname.empty() ? pending[i].filename : pending[i].tmpname;
+        int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+        if (fd < 0 || !syncData(fd)) {
+            log_err << pending[i].saver->parent_name << " : Error syncing " << path << ": " << strerror(errno)
+                    << std::endl;
+            synced[i] = false;
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        pending[i].sync = false;
+    }
+
+    uint64_t batch_bytes = 0;
+    size_t committed = 0;
+    for (size_t i = 0; i < pending.size(); i++) {
+        const pending_write_t &write = pending[i];
+        if (!synced[i]) {
+            // Never replace a good file with one that may not be on disk
+            if (!write.tmpname.empty()) {
+                unlink(write.tmpname.c_str());
+            }
+            continue;
+        }
+        // Log records were appended in place, only snapshots need a rename
+        if (!write.tmpname.empty() && rename(write.tmpname.c_str(), write.filename.c_str()) != 0) {
+            log_err << write.saver->parent_name << " : Error renaming " << write.tmpname << ": " << strerror(errno)
+                    << std::endl;
+            unlink(write.tmpname.c_str());
+            continue;
+        }
+        for (const auto& object : write.objects) {
+            object.first->saved_generation = object.second;
+        }
+        write.saver->last_cycle_bytes_ += write.bytes;
+        write.saver->total_bytes_ += write.bytes;
+        batch_bytes += write.bytes;
+        committed++;
+    }
+    log_debug << "saved " << committed << " of " << pending.size() << " files, "
+              << batch_bytes << " bytes" << std::endl;
+
+    // Persist the renames themselves, again one descriptor at a time
+    for (const auto& dir : directories) {
+        int fd = open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            log_err << "Error opening " << dir << ": " << strerror(errno) << std::endl;
+            continue;
+        }
+        if (fsync(fd) != 0) {
+            log_err << "Error syncing directory " << dir << ": " << strerror(errno) << std::endl;
+        }
+        close(fd);
     }
+    return committed;
 }
 
 void Saver::StopSaving(void) {
-    if (save_thread_.joinable()) {
-        exitSaveLoop.store(true);
-        cv_.notify_one(); // Notify the waiting thread to process the queue manually
-        save_thread_.join();
+    if (saving_.exchange(false)) {
+        SaveScheduler::instance().remove(this);
     }
 }
@@ -0,0 +1,209 @@
+#include "sketch_container.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "datatracer_log.h"
+
+static const char kContainerMagic[4] = {'D', 'T', 'C', '1'};
+static const uint32_t kContainerVersion = 1;
+static const size_t kHeaderSize = 24;
+static const size_t kIndexEntrySize = 32;
+
+uint32_t sketchChecksum(const uint8_t *data, size_t size) {
+    static uint32_t table[256];
+    static bool init = [] {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return true;
+    }();
+    (void)init;
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static void storeLE(uint8_t *dst, uint64_t value, int size) {
+    for (int i = 0; i < size; i++) {
+        dst[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+static uint64_t loadLE(const uint8_t *src, int size) {
+    uint64_t value = 0;
+    for (int i = 0; i < size; i++) {
+        value |= static_cast<uint64_t>(src[i]) << (8 * i);
+    }
+    return value;
+}
+
+static size_t alignUp(size_t value) {
+    return (value + 7) & ~static_cast<size_t>(7);
+}
+
+void encodeSketchContainer(const std::vector<sketch_container_entry_t> &entries, std::vector<uint8_t> &out) {
+    std::vector<const sketch_container_entry_t *> sorted;
+    sorted.reserve(entries.size());
+    for (const auto& entry : entries) {
+        sorted.push_back(&entry);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const sketch_container_entry_t *a, const sketch_container_entry_t *b) { return a->name < b->name; });
+    // Lookups binary search the names, so only the first entry of a name is kept
+    auto duplicate = [](const sketch_container_entry_t *a, const sketch_container_entry_t *b) {
+        if (a->name != b->name) {
+            return false;
+        }
+        log_err << "duplicate container entry " << b->name << ", skipped" << std::endl;
+        return true;
+    };
+    sorted.erase(std::unique(sorted.begin(), sorted.end(), duplicate), sorted.end());
+
+    // Size everything first so the image is built in a single allocation
+    const size_t index_end = kHeaderSize + sorted.size() * kIndexEntrySize;
+    size_t names_size = 0;
+    for (const auto *entry : sorted) {
+        names_size += entry->name.size();
+    }
+    size_t total = alignUp(index_end + names_size);
+    for (const auto *entry : sorted) {
+        total = alignUp(total + entry->size);
+    }
+    out.assign(total, 0);
+
+    uint8_t *base = out.data();
+    size_t name_pos = index_end;
+    size_t blob_pos = alignUp(index_end + names_size);
+    for (size_t i = 0; i < sorted.size(); i++) {
+        const sketch_container_entry_t *entry = sorted[i];
+        uint8_t *index = base + kHeaderSize + i * kIndexEntrySize;
+        storeLE(index, blob_pos, 8);
+        storeLE(index + 8, entry->size, 8);
+        storeLE(index + 16, static_cast<uint32_t>(entry->type), 4);
+        storeLE(index + 20, sketchChecksum(entry->data, entry->size), 4);
+        storeLE(index + 24, name_pos, 4);
+        storeLE(index + 28, entry->name.size(), 4);
+        memcpy(base + name_pos, entry->name.data(), entry->name.size());
+        name_pos += entry->name.size();
+        if (entry->size > 0) {
+            memcpy(base + blob_pos, entry->data, entry->size);
+        }
+        blob_pos = alignUp(blob_pos + entry->size);
+    }
+
+    memcpy(base, kContainerMagic, sizeof(kContainerMagic));
+    storeLE(base + 4, kContainerVersion, 4);
+    storeLE(base + 8, sorted.size(), 4);
+    storeLE(base + 12, sketchChecksum(base + kHeaderSize, name_pos - kHeaderSize), 4);
+    storeLE(base + 16, total, 8);
+}
+
+SketchContainer::SketchContainer() : map_(nullptr), length_(0), count_(0) {
+}
+
+SketchContainer::~SketchContainer() {
+    close();
+}
+
+bool SketchContainer::open(const std::string &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < kHeaderSize) {
+        ::close(fd);
+        return false;
+    }
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        log_err << "error mapping " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    map_ = static_cast<const uint8_t *>(map);
+    length_ = st.st_size;
+
+    const uint32_t count = static_cast<uint32_t>(loadLE(map_ + 8, 4));
+    const size_t index_end = kHeaderSize + static_cast<size_t>(count) * kIndexEntrySize;
+    bool valid = memcmp(map_, kContainerMagic, sizeof(kContainerMagic)) == 0 &&
+                 loadLE(map_ + 4, 4) == kContainerVersion &&
+                 loadLE(map_ + 16, 8) == length_ &&
+                 index_end <= length_;
+    if (valid) {
+        // The names follow the index, so the last entry bounds the checksummed region
+        size_t names_end = index_end;
+        for (uint32_t i = 0; i < count; i++) {
+            const uint8_t *index = map_ + kHeaderSize + i * kIndexEntrySize;
+            names_end = std::max<size_t>(names_end, loadLE(index + 24, 4) + loadLE(index + 28, 4));
+        }
+        valid = names_end <= length_ &&
+                loadLE(map_ + 12, 4) == sketchChecksum(map_ + kHeaderSize, names_end - kHeaderSize);
+    }
+    if (!valid) {
+        log_err << "invalid sketch container " << path << std::endl;
+        close();
+        return false;
+    }
+    count_ = count;
+    return true;
+}
+
+void SketchContainer::close() {
+    if (map_ != nullptr) {
+        munmap(const_cast<uint8_t *>(map_), length_);
+    }
+    map_ = nullptr;
+    length_ = 0;
+    count_ = 0;
+}
+
+std::vector<std::string> SketchContainer::names() const {
+    std::vector<std::string> result;
+    for (uint32_t i = 0; i < count_; i++) {
+        const uint8_t *index = map_ + kHeaderSize + i * kIndexEntrySize;
+        result.emplace_back(reinterpret_cast<const char *>(map_ + loadLE(index + 24, 4)), loadLE(index + 28, 4));
+    }
+    return result;
+}
+
+bool SketchContainer::find(const std::string &name, const uint8_t **data, size_t *size, int *type) const {
+    uint32_t lo = 0;
+    uint32_t hi = count_;
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        const uint8_t *index = map_ + kHeaderSize + mid * kIndexEntrySize;
+        const std::string key(reinterpret_cast<const char *>(map_ + loadLE(index + 24, 4)), loadLE(index + 28, 4));
+        if (key < name) {
+            lo = mid + 1;
+        } else if (name < key) {
+            hi = mid;
+        } else {
+            const uint64_t offset = loadLE(index, 8);
+            const uint64_t blob_size = loadLE(index + 8, 8);
+            if (offset > length_ || blob_size > length_ - offset ||
+                loadLE(index + 20, 4) != sketchChecksum(map_ + offset, blob_size)) {
+                log_err << "corrupt sketch " << name << " in container" << std::endl;
+                return false;
+            }
+            *data = map_ + offset;
+            *size = blob_size;
+            if (type != nullptr) {
+                *type = static_cast<int>(loadLE(index + 16, 4));
+            }
+            return true;
+        }
+    }
+    return false;
+}
@@ -1,10 +1,20 @@
 #include "tar_gz_creator.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <fstream>
 #include <vector>
 #include <tar.h>
 #include <zlib.h>
 #include <iostream>
+#include <deque>
+#include <memory>
 #include <boost/filesystem.hpp>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "thread_pool.h"
 
 namespace fs = boost::filesystem;
 
@@ -28,88 +38,443 @@ std::vector<std::string> TarGzCreator::collectFilesFromFolders(const std::vector
     return collectedFiles;
 }
 
-void TarGzCreator::addPadding(std::ofstream& stream, std::streamsize size) {
-    std::streamsize padding = 512 - (size % 512);
-    if (padding != 512) {
-        std::vector<char> paddingBuffer(padding, '\0');
-        stream.write(paddingBuffer.data(), paddingBuffer.size());
+// Chunk size of every read and deflate buffer; archiving memory is bounded by it
+static const size_t kChunkSize = 64 * 1024;
+
+// Stores a number as zero-padded octal, or as GNU base-256 when it does not fit
+static void setTarNumber(char *field, size_t width, unsigned long long value) {
+    if (width > 1 && value < (1ULL << (3 * (width - 1)))) {
+        snprintf(field, width, "%0*llo", static_cast<int>(width - 1), value);
+        return;
+    }
+    for (size_t i = width; i-- > 1; ) {
+        field[i] = static_cast<char>(value & 0xFF);
+        value >>= 8;
     }
+    field[0] = static_cast<char>(0x80);
 }
 
-bool TarGzCreator::createTar(const std::string& tarFilePath, const std::vector<std::string>& filePaths) {
-    std::ofstream tarFile(tarFilePath, std::ios::binary | std::ios::trunc);
+static unsigned long long getTarNumber(const char *field, size_t width) {
+    if (static_cast<unsigned char>(field[0]) & 0x80) {
+        unsigned long long value = 0;
+        for (size_t i = 1; i < width; i++) {
+            value = (value << 8) | static_cast<unsigned char>(field[i]);
+        }
+        return value;
+    }
+    return std::strtoull(std::string(field, strnlen(field, width)).c_str(), nullptr, 8);
+}
 
-    if (!tarFile.is_open()) {
-        return false;
+bool TarGzCreator::writeTarHeader(const std::string& name, unsigned long long size, const tar_sink_t& sink) {
+    // Only the first T_BLOCKSIZE bytes of libtar's struct are the on-disk ustar header
+    struct tar_header header;
+    std::memset(&header, 0, sizeof(header));
+
+    // Names over 100 bytes are split at a '/' into the ustar prefix field
+    std::string prefix;
+    std::string base = name;
+    if (name.size() >= sizeof(header.name)) {
+        size_t slash = name.find('/', name.size() - sizeof(header.name));
+        if (slash == std::string::npos || slash >= sizeof(header.prefix)) {
+            std::cerr << "Path too long for tar: " << name << std::endl;
+            return false;
+        }
+        prefix = name.substr(0, slash);
+        base = name.substr(slash + 1);
+    }
+    std::strncpy(header.name, base.c_str(), sizeof(header.name) - 1);
+    std::strncpy(header.prefix, prefix.c_str(), sizeof(header.prefix) - 1);
+
+    setTarNumber(header.mode, sizeof(header.mode), 0644);
+    setTarNumber(header.uid, sizeof(header.uid), 0);
+    setTarNumber(header.gid, sizeof(header.gid), 0);
+    setTarNumber(header.size, sizeof(header.size), size);
+    setTarNumber(header.mtime, sizeof(header.mtime), static_cast<unsigned long long>(std::time(nullptr)));
+    header.typeflag = REGTYPE;
+    std::memcpy(header.magic, TMAGIC, TMAGLEN);
+    std::memcpy(header.version, TVERSION, TVERSLEN);
+
+    // The checksum is computed with its own field set to spaces
+    std::memset(header.chksum, ' ', sizeof(header.chksum));
+    unsigned int checksum = 0;
+    const unsigned char *bytes = reinterpret_cast<const unsigned char*>(&header);
+    for (size_t i = 0; i < T_BLOCKSIZE; ++i) {
+        checksum += bytes[i];
     }
+    snprintf(header.chksum, sizeof(header.chksum), "%06o", checksum);
 
-    for (const auto& filePath : filePaths) {
-        std::ifstream inputFile(filePath, std::ios::binary | std::ios::ate);
+    return sink(reinterpret_cast<const char*>(&header), T_BLOCKSIZE);
+}
+
+bool TarGzCreator::writeTarStream(const std::vector<std::string>& filePaths, const tar_sink_t& sink) {
+    std::vector<char> buffer(kChunkSize);
+    static const char zeros[T_BLOCKSIZE] = {};
 
-        if (!inputFile.is_open()) {
+    for (const auto& filePath : filePaths) {
+        std::ifstream inputFile(filePath, std::ios::binary);
+        boost::system::error_code ec;
+        unsigned long long size = fs::file_size(filePath, ec);
+        if (!inputFile.is_open() || ec) {
             std::cerr << "Failed to open file: " << filePath << std::endl;
             continue;
         }
 
-        std::streamsize size = inputFile.tellg();
-        inputFile.seekg(0, std::ios::beg);
-
-        std::vector<char> buffer(size);
-        inputFile.read(buffer.data(), size);
-
-        struct tar_header header = {};
-        std::memset(&header, 0, sizeof(header));
-
-        std::string relativePath = fs::relative(filePath).string();
-        std::strncpy(header.name, relativePath.c_str(), sizeof(header.name) - 1);
+        if (!writeTarHeader(fs::relative(filePath).string(), size, sink)) {
+            continue;
+        }
 
-        snprintf(header.size, sizeof(header.size), "%011o", static_cast<int>(size));
-        snprintf(header.mode, sizeof(header.mode), "%07o", 0644);
-        snprintf(header.mtime, sizeof(header.mtime), "%011ld", std::time(nullptr));
-        header.typeflag = '0';
+        // Exactly the size recorded in the header is archived, even if the file changes meanwhile
+        unsigned long long remaining = size;
+        while (remaining > 0) {
+            std::streamsize want = static_cast<std::streamsize>(std::min<unsigned long long>(remaining, buffer.size()));
+            inputFile.read(buffer.data(), want);
+            std::streamsize got = inputFile.gcount();
+            if (got < want) {
+                std::memset(buffer.data() + got, 0, want - got);  // Truncated while archiving
+                std::cerr << "File shrank while archiving: " << filePath << std::endl;
+            }
+            if (!sink(buffer.data(), static_cast<size_t>(want))) {
+                return false;
+            }
+            remaining -= want;
+        }
 
-        unsigned int checksum = 0;
-        for (size_t i = 0; i < sizeof(header); ++i) {
-            checksum += static_cast<unsigned char>(reinterpret_cast<char*>(&header)[i]);
+        size_t padding = (T_BLOCKSIZE - size % T_BLOCKSIZE) % T_BLOCKSIZE;
+        if (padding > 0 && !sink(zeros, padding)) {
+            return false;
         }
-        snprintf(header.chksum, sizeof(header.chksum), "%06o", checksum);
+    }
 
-        tarFile.write(reinterpret_cast<char*>(&header), sizeof(header));
-        tarFile.write(buffer.data(), buffer.size());
+    // End of archive: two zero blocks
+    return sink(zeros, T_BLOCKSIZE) && sink(zeros, T_BLOCKSIZE);
+}
 
-        addPadding(tarFile, size);
-    }
+bool TarGzCreator::createTar(const std::string& tarFilePath, const std::vector<std::string>& filePaths) {
+    std::ofstream tarFile(tarFilePath, std::ios::binary | std::ios::trunc);
 
-    std::vector<char> eof(1024, '\0');
-    tarFile.write(eof.data(), eof.size());
+    if (!tarFile.is_open()) {
+        return false;
+    }
 
+    bool ok = writeTarStream(filePaths, [&tarFile](const char *data, size_t size) {
+        tarFile.write(data, size);
+        return static_cast<bool>(tarFile);
+    });
     tarFile.close();
 
+    return ok && !tarFile.fail();
+}
+
+bool TarGzCreator::createTarGz(const std::string& gzFilePath, const std::vector<std::string>& filePaths, int level) {
+    std::ofstream output(gzFilePath, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+        return false;
+    }
+
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    // windowBits 15 + 16 selects the gzip wrapper
+    if (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    std::vector<unsigned char> out(kChunkSize);
+
+    // Deflates one chunk and writes whatever output is ready
+    auto pump = [&](const char *data, size_t size, int flush) {
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        stream.avail_in = static_cast<uInt>(size);
+        int ret;
+        do {
+            stream.next_out = out.data();
+            stream.avail_out = static_cast<uInt>(out.size());
+            ret = deflate(&stream, flush);
+            if (ret == Z_STREAM_ERROR) {
+                return false;
+            }
+            output.write(reinterpret_cast<const char*>(out.data()), out.size() - stream.avail_out);
+            if (!output) {
+                return false;
+            }
+        } while (stream.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+        return true;
+    };
+
+    bool ok = writeTarStream(filePaths, [&pump](const char *data, size_t size) {
+        return pump(data, size, Z_NO_FLUSH);
+    });
+    ok = ok && pump(nullptr, 0, Z_FINISH);
+    deflateEnd(&stream);
+    output.close();
+
+    if (!ok || output.fail()) {
+        std::cerr << "Failed to write " << gzFilePath << std::endl;
+        return false;
+    }
     return true;
 }
 
 bool TarGzCreator::compressToGz(const std::string& tarFilePath, const std::string& gzFilePath) {
-    std::ifstream tarFile(tarFilePath, std::ios::binary | std::ios::ate);
+    std::ifstream tarFile(tarFilePath, std::ios::binary);
     gzFile gzOutput = gzopen(gzFilePath.c_str(), "wb");
 
     if (!tarFile.is_open() || !gzOutput) {
+        if (gzOutput) {
+            gzclose(gzOutput);
+        }
         return false;
     }
 
-    std::streamsize size = tarFile.tellg();
-    tarFile.seekg(0, std::ios::beg);
+    std::vector<char> buffer(kChunkSize);
+    bool ok = true;
+    while (ok && tarFile) {
+        tarFile.read(buffer.data(), buffer.size());
+        std::streamsize got = tarFile.gcount();
+        if (got > 0 && gzwrite(gzOutput, buffer.data(), static_cast<unsigned>(got)) != got) {
+            ok = false;
+        }
+    }
 
-    std::vector<char> buffer(size);
-    tarFile.read(buffer.data(), size);
+    ok = (gzclose(gzOutput) == Z_OK) && ok;
+    tarFile.close();
 
-    gzwrite(gzOutput, buffer.data(), buffer.size());
+    return ok;
+}
 
-    gzclose(gzOutput);
-    tarFile.close();
+// Deflate window; each parallel block is primed with this much of the previous input
+static const size_t kDictSize = 32 * 1024;
+
+/**
+ * pigz-style gzip writer: input is cut into blocks deflated independently on a
+ * pool and written in order. Non-final blocks end with a sync flush, so their
+ * raw deflate output concatenates into one valid stream; the gzip CRC is
+ * combined from the per-block CRCs.
+ */
+class ParallelGzWriter {
+public:
+    ParallelGzWriter(std::ofstream& out, size_t threads, int level, size_t blockSize)
+        : out_(out), pool_(threads), level_(level), blockSize_(std::max(blockSize, kDictSize)),
+          maxInflight_(2 * pool_.size()), crc_(crc32(0L, Z_NULL, 0)), total_(0), ok_(true) {
+        static const unsigned char header[10] = {0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, 0, 3};
+        out_.write(reinterpret_cast<const char*>(header), sizeof(header));
+        current_.reset(new block_t);
+        current_->input.reserve(blockSize_);
+    }
+
+    ~ParallelGzWriter() {
+        // Never leave a task referencing a destroyed block
+        for (auto& block : inflight_) {
+            block->done.wait();
+        }
+    }
+
+    bool write(const char *data, size_t size) {
+        while (size > 0 && ok_) {
+            size_t n = std::min(size, blockSize_ - current_->input.size());
+            current_->input.insert(current_->input.end(), data, data + n);
+            data += n;
+            size -= n;
+            if (current_->input.size() == blockSize_) {
+                submit(false);
+            }
+        }
+        return ok_;
+    }
+
+    bool finish() {
+        submit(true);
+        drain(0);
+        if (!ok_) {
+            return false;
+        }
+        unsigned char trailer[8];
+        for (int i = 0; i < 4; i++) {
+            trailer[i] = static_cast<unsigned char>(crc_ >> (8 * i));
+            trailer[4 + i] = static_cast<unsigned char>(total_ >> (8 * i));  // ISIZE is the size mod 2^32
+        }
+        out_.write(reinterpret_cast<const char*>(trailer), sizeof(trailer));
+        return static_cast<bool>(out_);
+    }
 
+private:
+    struct block_t {
+        std::vector<unsigned char> input;
+        std::vector<unsigned char> dict;    // Tail of the previous block's input
+        std::vector<unsigned char> output;  // Raw deflate data
+        uLong crc;
+        bool last;
+        bool ok;
+        std::future<void> done;
+    };
+
+    void submit(bool last) {
+        std::unique_ptr<block_t> block(std::move(current_));
+        block->last = last;
+        current_.reset(new block_t);
+        if (!last) {
+            current_->input.reserve(blockSize_);
+            size_t keep = std::min(kDictSize, block->input.size());
+            current_->dict.assign(block->input.end() - keep, block->input.end());
+        }
+        block_t *raw = block.get();
+        int level = level_;
+        block->done = pool_.submit([raw, level] { compressBlock(*raw, level); });
+        inflight_.push_back(std::move(block));
+        drain(maxInflight_);
+    }
+
+    // Writes finished blocks in order until at most keep are in flight
+    void drain(size_t keep) {
+        while (inflight_.size() > keep) {
+            std::unique_ptr<block_t> block(std::move(inflight_.front()));
+            inflight_.pop_front();
+            block->done.wait();
+            if (!block->ok) {
+                ok_ = false;
+                continue;
+            }
+            crc_ = crc32_combine(crc_, block->crc, static_cast<z_off_t>(block->input.size()));
+            total_ += block->input.size();
+            out_.write(reinterpret_cast<const char*>(block->output.data()), block->output.size());
+            if (!out_) {
+                ok_ = false;
+            }
+        }
+    }
+
+    static void compressBlock(block_t& block, int level) {
+        block.ok = false;
+        block.crc = crc32(crc32(0L, Z_NULL, 0), block.input.data(), static_cast<uInt>(block.input.size()));
+        z_stream stream;
+        std::memset(&stream, 0, sizeof(stream));
+        if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return;
+        }
+        if (!block.dict.empty()) {
+            deflateSetDictionary(&stream, block.dict.data(), static_cast<uInt>(block.dict.size()));
+        }
+        // Room for the sync flush marker on top of the bound
+        block.output.resize(deflateBound(&stream, block.input.size()) + 16);
+        stream.next_in = block.input.data();
+        stream.avail_in = static_cast<uInt>(block.input.size());
+        stream.next_out = block.output.data();
+        stream.avail_out = static_cast<uInt>(block.output.size());
+        const int flush = block.last ? Z_FINISH : Z_SYNC_FLUSH;
+        int ret = deflate(&stream, flush);
+        block.ok = block.last ? ret == Z_STREAM_END : (ret == Z_OK && stream.avail_in == 0 && stream.avail_out > 0);
+        block.output.resize(block.output.size() - stream.avail_out);
+        deflateEnd(&stream);
+    }
+
+    std::ofstream& out_;
+    ThreadPool pool_;
+    const int level_;
+    const size_t blockSize_;
+    const size_t maxInflight_;
+    std::unique_ptr<block_t> current_;
+    std::deque<std::unique_ptr<block_t>> inflight_;
+    uLong crc_;
+    uint64_t total_;
+    bool ok_;
+};
+
+bool TarGzCreator::createTarGzParallel(const std::string& gzFilePath, const std::vector<std::string>& filePaths,
+                                       size_t threads, int level, size_t blockSize) {
+    std::ofstream output(gzFilePath, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+        return false;
+    }
+    bool ok;
+    {
+        ParallelGzWriter writer(output, threads, level, blockSize);
+        ok = writeTarStream(filePaths, [&writer](const char *data, size_t size) {
+            return writer.write(data, size);
+        });
+        ok = writer.finish() && ok;
+    }
+    output.close();
+    if (!ok || output.fail()) {
+        std::cerr << "Failed to write " << gzFilePath << std::endl;
+        return false;
+    }
     return true;
 }
 
+bool TarGzCreator::compressToGzParallel(const std::string& tarFilePath, const std::string& gzFilePath,
+                                        size_t threads, int level, size_t blockSize) {
+    std::ifstream tarFile(tarFilePath, std::ios::binary);
+    std::ofstream output(gzFilePath, std::ios::binary | std::ios::trunc);
+    if (!tarFile.is_open() || !output.is_open()) {
+        return false;
+    }
+    bool ok = true;
+    {
+        ParallelGzWriter writer(output, threads, level, blockSize);
+        std::vector<char> buffer(kChunkSize);
+        while (ok && tarFile) {
+            tarFile.read(buffer.data(), buffer.size());
+            ok = writer.write(buffer.data(), static_cast<size_t>(tarFile.gcount()));
+        }
+        ok = writer.finish() && ok;
+    }
+    output.close();
+    return ok && !output.fail();
+}
+
+bool TarGzCreator::createTarZst(const std::string& zstFilePath, const std::vector<std::string>& filePaths,
+                                size_t threads, int level) {
+#ifdef HAVE_ZSTD
+    std::ofstream output(zstFilePath, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+        return false;
+    }
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    if (cctx == nullptr) {
+        return false;
+    }
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+    // Ignored (single-threaded) if libzstd was built without ZSTD_MULTITHREAD
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, static_cast<int>(threads));
+    std::vector<char> out(ZSTD_CStreamOutSize());
+
+    auto pump = [&](const char *data, size_t size, ZSTD_EndDirective mode) {
+        ZSTD_inBuffer in = {data, size, 0};
+        size_t remaining;
+        do {
+            ZSTD_outBuffer chunk = {out.data(), out.size(), 0};
+            remaining = ZSTD_compressStream2(cctx, &chunk, &in, mode);
+            if (ZSTD_isError(remaining)) {
+                std::cerr << "zstd: " << ZSTD_getErrorName(remaining) << std::endl;
+                return false;
+            }
+            output.write(out.data(), chunk.pos);
+            if (!output) {
+                return false;
+            }
+        } while (mode == ZSTD_e_end ? remaining != 0 : in.pos < in.size);
+        return true;
+    };
+
+    bool ok = writeTarStream(filePaths, [&pump](const char *data, size_t size) {
+        return pump(data, size, ZSTD_e_continue);
+    });
+    ok = ok && pump(nullptr, 0, ZSTD_e_end);
+    ZSTD_freeCCtx(cctx);
+    output.close();
+    if (!ok || output.fail()) {
+        std::cerr << "Failed to write " << zstFilePath << std::endl;
+        return false;
+    }
+    return true;
+#else
+    (void)filePaths;
+    (void)threads;
+    (void)level;
+    std::cerr << "Cannot write " << zstFilePath << ": built without zstd" << std::endl;
+    return false;
+#endif
+}
+
 // Function to decompress a gz file
 bool TarGzCreator::decompressGz(const std::string& gzFilePath, const std::string& outputFilePath) {
     gzFile gzInput = gzopen(gzFilePath.c_str(), "rb");
@@ -142,18 +507,24 @@ bool TarGzCreator::unpackTar(const std::string& tarFilePath, const std::string&
         return false;
     }
 
+    std::vector<char> buffer(kChunkSize);
     while (tarFile) {
-        struct tar_header header = {};
-        tarFile.read(reinterpret_cast<char*>(&header), sizeof(header));
+        struct tar_header header;
+        std::memset(&header, 0, sizeof(header));
+        tarFile.read(reinterpret_cast<char*>(&header), T_BLOCKSIZE);
 
-        if (tarFile.gcount() == 0) {
+        if (tarFile.gcount() < T_BLOCKSIZE || header.name[0] == '\0') {
             break; // End of tarball
         }
 
         // Get the file size from the tar header
-        std::streamsize size = std::stoul(std::string(header.size), nullptr, 8);
+        unsigned long long size = getTarNumber(header.size, sizeof(header.size));
 
-        std::string relativeFilePath(header.name);
+        std::string relativeFilePath(header.name, strnlen(header.name, sizeof(header.name)));
+        std::string prefix(header.prefix, strnlen(header.prefix, sizeof(header.prefix)));
+        if (!prefix.empty()) {
+            relativeFilePath = prefix + "/" + relativeFilePath;
+        }
         std::string outputFilePath = outputFolderPath + "/" + relativeFilePath;
 
         // Create directories as needed
@@ -164,14 +535,18 @@ bool TarGzCreator::unpackTar(const std::string& tarFilePath, const std::string&
             return false;
         }
 
-        std::vector<char> buffer(size);
-        tarFile.read(buffer.data(), size);
-        outputFile.write(buffer.data(), buffer.size());
+        unsigned long long remaining = size;
+        while (remaining > 0 && tarFile) {
+            std::streamsize want = static_cast<std::streamsize>(std::min<unsigned long long>(remaining, buffer.size()));
+            tarFile.read(buffer.data(), want);
+            outputFile.write(buffer.data(), tarFile.gcount());
+            remaining -= tarFile.gcount();
+        }
 
         outputFile.close();
 
         // Skip padding to align with 512-byte blocks
-        tarFile.seekg((512 - (size % 512)) % 512, std::ios::cur);
+        tarFile.seekg((T_BLOCKSIZE - size % T_BLOCKSIZE) % T_BLOCKSIZE, std::ios::cur);
     }
 
     tarFile.close();
@@ -1,10 +1,12 @@
 #ifndef TAR_GZ_CREATOR_H
 #define TAR_GZ_CREATOR_H
 
+#include <functional>
 #include <vector>
 #include <string>
 #include <boost/filesystem.hpp>
 #include <libtar.h>  // Header for libtar
+#include <zlib.h>
 
 
 class TarGzCreator {
@@ -12,11 +14,43 @@ public:
     TarGzCreator();
     bool createTar(const std::string& tarFilePath, const std::vector<std::string>& filePaths);
     bool compressToGz(const std::string& tarFilePath, const std::string& gzFilePath);
+    /**
+     * @brief Archives files straight into a .tar.gz in one pass.
+     *
+     * Each file is read in fixed-size chunks, framed as tar blocks and fed to a
+     * gzip deflate stream, so memory use does not depend on the file sizes and
+     * no intermediate .tar is written.
+     */
+    bool createTarGz(const std::string& gzFilePath, const std::vector<std::string>& filePaths, int level = Z_DEFAULT_COMPRESSION);
+    /**
+     * @brief createTarGz() with deflate spread over a thread pool, pigz style.
+     *
+     * The tar stream is cut into blockSize chunks, each deflated independently
+     * (primed with the previous 32 KiB as dictionary) and concatenated into one
+     * standard gzip member. At most two blocks per thread are in flight.
+     */
+    bool createTarGzParallel(const std::string& gzFilePath, const std::vector<std::string>& filePaths, size_t threads,
+                             int level = Z_DEFAULT_COMPRESSION, size_t blockSize = 128 * 1024);
+    /**
+     * @brief compressToGz() with the parallel deflate of createTarGzParallel().
+     */
+    bool compressToGzParallel(const std::string& tarFilePath, const std::string& gzFilePath, size_t threads,
+                              int level = Z_DEFAULT_COMPRESSION, size_t blockSize = 128 * 1024);
+    /**
+     * @brief Archives files into a .tar.zst using zstd's multi-threaded compressor.
+     * @return false if the library was built without zstd (HAVE_ZSTD).
+     */
+    bool createTarZst(const std::string& zstFilePath, const std::vector<std::string>& filePaths, size_t threads,
+                      int level = 3);
     std::vector<std::string> collectFilesFromFolders(const std::vector<std::string>& folders);
     bool decompressGz(const std::string& gzFilePath, const std::string& outputFilePath);
     bool unpackTar(const std::string& tarFilePath, const std::string& outputFolderPath);
 private:
-    void addPadding(std::ofstream& stream, std::streamsize size);
+    // Receives consecutive chunks of the tar stream; false aborts the archive
+    typedef std::function<bool(const char *data, size_t size)> tar_sink_t;
+
+    bool writeTarStream(const std::vector<std::string>& filePaths, const tar_sink_t& sink);
+    bool writeTarHeader(const std::string& name, unsigned long long size, const tar_sink_t& sink);
 };
 
 #endif // TAR_GZ_CREATOR_H
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "change_tracker.h"
+
+class ChangeTrackerTest : public ::testing::TestWithParam<bool> {
+protected:
+    void SetUp() override {
+        char tmpl[] = "/tmp/change_tracker_test.XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        dir_ = tmpl;
+        write("a.png", "first image");
+        write("b.png", "second image");
+        write(".upload_spool", "journal");
+    }
+
+    void TearDown() override {
+        for (const char* name : {"a.png", "b.png", "c.png", "d.png", ".upload_spool"}) {
+            std::remove((dir_ + "/" + name).c_str());
+        }
+        rmdir(dir_.c_str());
+    }
+
+    void write(const std::string& name, const std::string& contents) {
+        std::ofstream(dir_ + "/" + name, std::ios::binary) << contents;
+    }
+
+    // Sets the mtime a second ahead, as a touch or a rewrite would
+    void touch(const std::string& name) {
+        struct stat st;
+        ASSERT_EQ(stat((dir_ + "/" + name).c_str(), &st), 0);
+        struct timeval times[2];
+        times[0].tv_sec = st.st_atime;
+        times[0].tv_usec = 0;
+        times[1].tv_sec = st.st_mtime + 1;
+        times[1].tv_usec = 0;
+        ASSERT_EQ(utimes((dir_ + "/" + name).c_str(), times), 0);
+    }
+
+    static void uploadAll(ChangeTracker& tracker, const std::vector<changed_file_t>& files) {
+        for (const changed_file_t& file : files) {
+            tracker.markUploaded(file.path, file.version.size, file.version.mtime_ns);
+        }
+    }
+
+    std::string dir_;
+};
+
+// Only new and changed files are reported after the first pass
+TEST_P(ChangeTrackerTest, ReportsOnlyNewOrChanged) {
+    ChangeTracker tracker(dir_, GetParam());
+    std::vector<changed_file_t> files = tracker.changed();
+    ASSERT_EQ(files.size(), 2u);  // The dot file is skipped
+    EXPECT_EQ(files[0].path, dir_ + "/a.png");
+    uploadAll(tracker, files);
+
+    EXPECT_TRUE(tracker.changed().empty());
+    uint64_t hashed = tracker.getFilesHashed();
+
+    write("a.png", "first image, edited");
+    write("c.png", "third image");
+    files = tracker.changed();
+    ASSERT_EQ(files.size(), 2u);
+    EXPECT_EQ(files[0].path, dir_ + "/a.png");
+    EXPECT_EQ(files[1].path, dir_ + "/c.png");
+    EXPECT_EQ(tracker.getFilesHashed(), hashed + 2);
+
+    // Reported but not uploaded yet: not reported again, not rehashed
+    EXPECT_TRUE(tracker.changed().empty());
+    EXPECT_EQ(tracker.getFilesHashed(), hashed + 2);
+    uploadAll(tracker, files);
+    EXPECT_TRUE(tracker.changed().empty());
+}
+
+// A new mtime with the same contents is hashed once and not reported
+TEST_P(ChangeTrackerTest, IgnoresTouchWithSameContents) {
+    ChangeTracker tracker(dir_, GetParam());
+    uploadAll(tracker, tracker.changed());
+
+    write("b.png", "second image");
+    touch("b.png");
+    EXPECT_TRUE(tracker.changed().empty());
+    uint64_t hashed = tracker.getFilesHashed();
+    EXPECT_TRUE(tracker.changed().empty());
+    EXPECT_EQ(tracker.getFilesHashed(), hashed);
+}
+
+// Deleted and recreated files are reported again
+TEST_P(ChangeTrackerTest, ForgetsDeletedFiles) {
+    ChangeTracker tracker(dir_, GetParam());
+    uploadAll(tracker, tracker.changed());
+
+    std::remove((dir_ + "/a.png").c_str());
+    EXPECT_TRUE(tracker.changed().empty());
+    write("a.png", "first image");
+    std::vector<changed_file_t> files = tracker.changed();
+    ASSERT_EQ(files.size(), 1u);
+    EXPECT_EQ(files[0].path, dir_ + "/a.png");
+}
+
+// A file tracked on its own ignores its neighbours
+TEST_P(ChangeTrackerTest, TracksSingleFile) {
+    ChangeTracker tracker(dir_ + "/a.png", GetParam());
+    std::vector<changed_file_t> files = tracker.changed();
+    ASSERT_EQ(files.size(), 1u);
+    EXPECT_EQ(files[0].path, dir_ + "/a.png");
+    uploadAll(tracker, files);
+
+    write("b.png", "second image, edited");
+    EXPECT_TRUE(tracker.changed().empty());
+    write("a.png", "first image, edited");
+    EXPECT_EQ(tracker.changed().size(), 1u);
+}
+
+INSTANTIATE_TEST_SUITE_P(PollingAndInotify, ChangeTrackerTest, ::testing::Values(false, true));
+
+// With inotify the directory is scanned once, later calls only look at events
+TEST(ChangeTrackerInotifyTest, DoesNotRescan) {
+    char tmpl[] = "/tmp/change_tracker_test.XXXXXX";
+    ASSERT_NE(mkdtemp(tmpl), nullptr);
+    std::string dir = tmpl;
+    ChangeTracker tracker(dir);
+    if (!tracker.usingInotify()) {
+        rmdir(dir.c_str());
+        GTEST_SKIP() << "inotify not available";
+    }
+    EXPECT_TRUE(tracker.changed().empty());
+    for (int i = 0; i < 10; ++i) {
+        std::ofstream(dir + "/d.png", std::ios::binary) << "image " << i;
+        EXPECT_EQ(tracker.changed().size(), 1u);
+        EXPECT_TRUE(tracker.changed().empty());
+    }
+    EXPECT_EQ(tracker.getScans(), 1u);
+    std::remove((dir + "/d.png").c_str());
+    rmdir(dir.c_str());
+}
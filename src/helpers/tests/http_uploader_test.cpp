@@ -1,7 +1,12 @@
 #include <gtest/gtest.h>
+#include <chrono>
 #include <fstream>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
 
 #include "http_uploader.h"
+#include "loopback_http_server.h"
 
 // Basic test for successful POST request
 TEST(HttpUploaderTest, PostFile) {
@@ -21,3 +26,122 @@ TEST(HttpUploaderTest, PostFile) {
     // Cleanup the dummy file after test
     std::remove(testFilePath.c_str());
 }
+
+// Consecutive uploads reuse the pooled keep-alive connection
+TEST(HttpUploaderTest, ReusesConnections) {
+    LoopbackHttpServer server;
+    HttpUploader uploader(server.url(), "dummy_token", 2);
+
+    std::string testFilePath = "test_pooled_file.txt";
+    std::ofstream(testFilePath) << "Pooled upload";
+
+    for (int i = 0; i < 20; ++i) {
+        ASSERT_TRUE(uploader.postFile(testFilePath, "00.00.00", std::time(nullptr)));
+    }
+    EXPECT_EQ(server.requests(), 20u);
+    EXPECT_EQ(server.connections(), 1u);
+    EXPECT_EQ(uploader.getConnectionsOpened(), 1u);
+    EXPECT_NE(server.lastBody().find("Pooled upload"), std::string::npos);
+
+    // Uploads from several threads each take their own handle
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 10; ++i) {
+                EXPECT_TRUE(uploader.postFile(testFilePath, "00.00.00", std::time(nullptr)));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(server.requests(), 60u);
+    EXPECT_LE(uploader.idle_.size(), 2u);
+
+    server.setStatus(500);
+    EXPECT_FALSE(uploader.postFile(testFilePath, "00.00.00", std::time(nullptr)));
+
+    std::remove(testFilePath.c_str());
+}
+
+// A large file is streamed from disk instead of being loaded into memory
+TEST(HttpUploaderTest, StreamsLargeFile) {
+    LoopbackHttpServer server;
+    server.setKeepBodies(false);
+    HttpUploader uploader(server.url(), "dummy_token");
+
+    std::string testFilePath = "test_large_file.bin";
+    const size_t chunk = 1024 * 1024;
+    const size_t chunks = 96;
+    {
+        std::ofstream file(testFilePath, std::ios::binary);
+        std::string block(chunk, 'L');
+        for (size_t i = 0; i < chunks; ++i) {
+            file.write(block.data(), block.size());
+        }
+    }
+
+    struct rusage before;
+    getrusage(RUSAGE_SELF, &before);
+    ASSERT_TRUE(uploader.postFile(testFilePath, "00.00.00", std::time(nullptr)));
+    struct rusage after;
+    getrusage(RUSAGE_SELF, &after);
+
+    EXPECT_GT(server.lastBodySize(), chunk * chunks);  // The file plus the form fields
+    EXPECT_LT(after.ru_maxrss - before.ru_maxrss, 16 * 1024);  // KiB; the file is 96 MiB
+
+    std::remove(testFilePath.c_str());
+}
+
+// Queued uploads run concurrently on the event loop, each reporting through its callback
+TEST(HttpUploaderTest, ConcurrentAsyncUploads) {
+    LoopbackHttpServer server;
+    server.setDelay(std::chrono::milliseconds(50));
+    HttpUploader uploader(server.url(), "dummy_token", 8, 8);
+
+    std::string testFilePath = "test_async_file.txt";
+    std::ofstream(testFilePath) << "Async upload";
+
+    const size_t uploads = 32;
+    std::atomic<size_t> succeeded(0);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < uploads; ++i) {
+        uploader.postFileAsync(testFilePath, "00.00.00", std::time(nullptr), [&](const upload_result_t& result) {
+            EXPECT_EQ(result.filePath, testFilePath);
+            EXPECT_EQ(result.status, 200);
+            EXPECT_GT(result.bytesSent, 0u);
+            if (result.ok) {
+                succeeded++;
+            }
+        });
+    }
+    uploader.waitIdle();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(succeeded.load(), uploads);
+    EXPECT_EQ(server.requests(), uploads);
+    // One at a time would take uploads x 50 ms
+    EXPECT_LT(elapsed, std::chrono::milliseconds(50 * uploads / 2));
+    EXPECT_GT(server.connections(), 1u);
+    EXPECT_LE(server.connections(), 8u);
+
+    upload_stats_t stats = uploader.getStats();
+    EXPECT_EQ(stats.completed, uploads);
+    EXPECT_EQ(stats.failed, 0u);
+    EXPECT_EQ(stats.queued, 0u);
+    EXPECT_EQ(stats.inFlight, 0u);
+    EXPECT_GT(stats.filesPerSecond, 0.0);
+    EXPECT_GT(stats.bytesPerSecond, 0.0);
+
+    // Missing files and error statuses are reported as failures
+    bool missingFailed = false;
+    uploader.postFileAsync("missing_file.txt", "00.00.00", std::time(nullptr),
+                           [&](const upload_result_t& result) { missingFailed = !result.ok; });
+    server.setStatus(500);
+    uploader.postFileAsync(testFilePath, "00.00.00", std::time(nullptr));
+    uploader.waitIdle();
+    EXPECT_TRUE(missingFailed);
+    EXPECT_EQ(uploader.getStats().failed, 2u);
+
+    std::remove(testFilePath.c_str());
+}
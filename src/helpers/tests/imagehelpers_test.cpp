@@ -43,6 +43,43 @@ TEST_F(ImageProcessingTest, calculateContrast) {
     EXPECT_GE(contrast, 0); // Contrast should not be negative
 }
 
+// Test computeImageStats matches the individual metric functions
+TEST_F(ImageProcessingTest, computeImageStats) {
+    cv::Mat noisy(64, 48, CV_8UC3);
+    cv::randu(noisy, cv::Scalar::all(0), cv::Scalar::all(256));
+
+    image_stats_t stats = computeImageStats(noisy, STATS_ALL);
+    EXPECT_NEAR(statsSNR(stats), calculateSNR(noisy), 1e-6);
+    EXPECT_NEAR(statsContrast(stats), calculateContrast(noisy), 1e-9);
+    EXPECT_NEAR(statsBrightness(stats), calculateBrightness(noisy), 1e-9);
+    EXPECT_NEAR(stats.laplacianVariance, calculateSharpnessLaplacian(noisy), 1e-6);
+
+    image_stats_t grayStats = computeImageStats(grayscaleImage, STATS_MEAN_STDDEV | STATS_MIN_MAX);
+    EXPECT_DOUBLE_EQ(grayStats.mean, 127.0);
+    EXPECT_DOUBLE_EQ(grayStats.stddev, 0.0);
+    EXPECT_DOUBLE_EQ(grayStats.min, 127.0);
+    EXPECT_DOUBLE_EQ(grayStats.max, 127.0);
+}
+
+// Test calculateChannelHistograms function
+TEST_F(ImageProcessingTest, calculateChannelHistograms) {
+    std::vector<channelHistogram> histograms;
+    ASSERT_EQ(calculateChannelHistograms(colorImage, histograms), 0);
+    ASSERT_EQ(histograms.size(), 3u);
+    EXPECT_EQ(histograms[0][100], 100u * 100u);
+    EXPECT_EQ(histograms[1][150], 100u * 100u);
+    EXPECT_EQ(histograms[2][200], 100u * 100u);
+
+    cv::Mat roi = grayscaleImage(cv::Rect(0, 0, 33, 17)); // Non-continuous view
+    ASSERT_EQ(calculateChannelHistograms(roi, histograms), 0);
+    ASSERT_EQ(histograms.size(), 1u);
+    EXPECT_EQ(histograms[0][127], 33u * 17u);
+    EXPECT_EQ(histograms[0][0], 0u);
+
+    cv::Mat empty;
+    EXPECT_THROW(calculateChannelHistograms(empty, histograms), std::runtime_error);
+}
+
 // Test saveImageWithIncrementalName function
 TEST_F(ImageProcessingTest, SaveImageWithIncrementalName) {
     std::string savedImagePath = saveImageWithIncrementalName(colorImage, testImagePath, testImageBaseName);
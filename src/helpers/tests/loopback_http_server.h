@@ -0,0 +1,219 @@
+/**
+ * @file loopback_http_server.h
+ * @brief Minimal keep-alive HTTP/1.1 server on 127.0.0.1 standing in for the upload endpoint in tests.
+ */
+
+#ifndef LOOPBACK_HTTP_SERVER_H
+#define LOOPBACK_HTTP_SERVER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * @class LoopbackHttpServer
+ * @brief Answers every request with a fixed status, counting connections and requests.
+ *
+ * Request bodies with Content-Length or chunked encoding are read in full;
+ * the last body is kept for inspection unless setKeepBodies(false), which
+ * only counts their size so large uploads do not grow the test process.
+ * setDelay() holds every response back, standing in for a remote endpoint's
+ * round trip.
+ */
+class LoopbackHttpServer {
+public:
+  explicit LoopbackHttpServer(int status = 200)
+      : status_(status), delayMs_(0), connections_(0), requests_(0), lastBodySize_(0), keepBodies_(true),
+        stop_(false) {
+    listen_ = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listen_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    bind(listen_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    listen(listen_, 64);
+    socklen_t len = sizeof(addr);
+    getsockname(listen_, reinterpret_cast<sockaddr*>(&addr), &len);
+    port_ = ntohs(addr.sin_port);
+    acceptThread_ = std::thread(&LoopbackHttpServer::acceptLoop, this);
+  }
+
+  ~LoopbackHttpServer() {
+    stop_.store(true);
+    shutdown(listen_, SHUT_RDWR);
+    close(listen_);
+    acceptThread_.join();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (int fd : clients_) {
+        shutdown(fd, SHUT_RDWR);
+      }
+    }
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  LoopbackHttpServer(const LoopbackHttpServer&) = delete;
+  LoopbackHttpServer& operator=(const LoopbackHttpServer&) = delete;
+
+  std::string url(const std::string& path = "/upload") const {
+    return "http://127.0.0.1:" + std::to_string(port_) + path;
+  }
+  void setStatus(int status) { status_.store(status); }
+  void setKeepBodies(bool keep) { keepBodies_.store(keep); }
+  void setDelay(std::chrono::milliseconds delay) { delayMs_.store(delay.count()); }
+  size_t lastBodySize() const { return lastBodySize_.load(); }
+  size_t connections() const { return connections_.load(); }
+  size_t requests() const { return requests_.load(); }
+  std::string lastBody() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lastBody_;
+  }
+
+private:
+  void acceptLoop() {
+    while (!stop_.load()) {
+      int fd = accept(listen_, nullptr, nullptr);
+      if (fd < 0) {
+        break;
+      }
+      connections_++;
+      std::lock_guard<std::mutex> lock(mutex_);
+      clients_.push_back(fd);
+      workers_.emplace_back(&LoopbackHttpServer::serve, this, fd);
+    }
+  }
+
+  // Reads until buffer holds at least size bytes; false on EOF
+  static bool fill(int fd, std::string& buffer, size_t size) {
+    char chunk[64 * 1024];
+    while (buffer.size() < size) {
+      ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+      if (n <= 0) {
+        return false;
+      }
+      buffer.append(chunk, n);
+    }
+    return true;
+  }
+
+  // Moves length body bytes out of the connection, into body when bodies are kept
+  bool consume(int fd, std::string& buffer, size_t length, std::string& body) {
+    while (length > 0) {
+      if (buffer.empty() && !fill(fd, buffer, 1)) {
+        return false;
+      }
+      size_t n = std::min(length, buffer.size());
+      if (keepBodies_.load()) {
+        body.append(buffer, 0, n);
+      }
+      buffer.erase(0, n);
+      length -= n;
+    }
+    return true;
+  }
+
+  static bool readLine(int fd, std::string& buffer, std::string& line) {
+    size_t end;
+    while ((end = buffer.find("\r\n")) == std::string::npos) {
+      if (!fill(fd, buffer, buffer.size() + 1)) {
+        return false;
+      }
+    }
+    line = buffer.substr(0, end);
+    buffer.erase(0, end + 2);
+    return true;
+  }
+
+  void serve(int fd) {
+    std::string buffer;
+    while (!stop_.load()) {
+      size_t end;
+      while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+        if (!fill(fd, buffer, buffer.size() + 1)) {
+          finish(fd);
+          return;
+        }
+      }
+      std::string head = buffer.substr(0, end);
+      buffer.erase(0, end + 4);
+      std::string lower = head;
+      std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+
+      std::string body;
+      size_t bodySize = 0;
+      size_t pos = lower.find("content-length:");
+      if (pos != std::string::npos) {
+        size_t length = std::strtoul(head.c_str() + pos + 15, nullptr, 10);
+        if (!consume(fd, buffer, length, body)) {
+          break;
+        }
+        bodySize = length;
+      } else if (lower.find("transfer-encoding: chunked") != std::string::npos) {
+        std::string line;
+        while (readLine(fd, buffer, line)) {
+          size_t length = std::strtoul(line.c_str(), nullptr, 16);
+          if (!consume(fd, buffer, length, body) || !fill(fd, buffer, 2)) {
+            break;
+          }
+          bodySize += length;
+          buffer.erase(0, 2);
+          if (length == 0) {
+            break;
+          }
+        }
+      }
+      requests_++;
+      lastBodySize_.store(bodySize);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lastBody_.swap(body);
+      }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(delayMs_.load()));
+      std::string response = "HTTP/1.1 " + std::to_string(status_.load()) + " Status\r\nContent-Length: 0\r\n\r\n";
+      if (send(fd, response.data(), response.size(), MSG_NOSIGNAL) < 0 ||
+          lower.find("connection: close") != std::string::npos) {
+        break;
+      }
+    }
+    finish(fd);
+  }
+
+  void finish(int fd) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    clients_.erase(std::remove(clients_.begin(), clients_.end(), fd), clients_.end());
+    close(fd);
+  }
+
+  int listen_;
+  int port_;
+  std::atomic<int> status_;
+  std::atomic<long> delayMs_;
+  std::atomic<size_t> connections_;
+  std::atomic<size_t> requests_;
+  std::atomic<size_t> lastBodySize_;
+  std::atomic<bool> keepBodies_;
+  std::atomic<bool> stop_;
+  std::thread acceptThread_;
+  std::mutex mutex_;
+  std::vector<int> clients_;
+  std::vector<std::thread> workers_;
+  std::string lastBody_;
+};
+
+#endif // LOOPBACK_HTTP_SERVER_H
@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include <opencv2/opencv.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include "samplewriter.h"
+
+class SampleWriterTest : public ::testing::Test {
+protected:
+    std::string testPath = "test_samples";
+    sample_writer_config_t config;
+
+    void SetUp() override {
+        boost::filesystem::remove_all(testPath);
+        std::map<std::string, std::string> ini;
+        config = parseSampleWriterConfig(ini);
+    }
+
+    void TearDown() override {
+        boost::filesystem::remove_all(testPath);
+    }
+};
+
+// Test the INI keys are parsed and removed from the section
+TEST_F(SampleWriterTest, ParseConfig) {
+    std::map<std::string, std::string> ini = {
+        {"sample_codec", "jpeg"},
+        {"sample_queue_size", "8"},
+        {"sample_drop_policy", "oldest"},
+        {"NOISE", "0.5"},
+    };
+    sample_writer_config_t parsed = parseSampleWriterConfig(ini);
+    EXPECT_EQ(parsed.codec, SAMPLE_CODEC_JPEG);
+    EXPECT_EQ(parsed.queue_size, 8u);
+    EXPECT_EQ(parsed.drop_policy, SAMPLE_DROP_OLDEST);
+    EXPECT_EQ(ini.size(), 1u);
+}
+
+// Test queued samples are written with increasing indices
+TEST_F(SampleWriterTest, WritesIncrementalNames) {
+    cv::Mat img(16, 16, CV_8UC3, cv::Scalar(1, 2, 3));
+    {
+        SampleWriter writer(config);
+        EXPECT_TRUE(writer.enqueue(img, testPath, "MARGIN"));
+        EXPECT_TRUE(writer.enqueue(img, testPath, "MARGIN"));
+        writer.stop();
+        EXPECT_EQ(writer.getWrittenCount(), 2u);
+    }
+    EXPECT_TRUE(boost::filesystem::exists(testPath + "/MARGIN0001.png"));
+    EXPECT_TRUE(boost::filesystem::exists(testPath + "/MARGIN0002.png"));
+
+    // A new writer continues after the files already on disk
+    SampleWriter writer(config);
+    EXPECT_TRUE(writer.enqueue(img, testPath, "MARGIN"));
+    writer.stop();
+    EXPECT_TRUE(boost::filesystem::exists(testPath + "/MARGIN0003.png"));
+}
+
+// Test a frame selected by several metrics is written once with a manifest line
+TEST_F(SampleWriterTest, SingleWriteForMultipleReasons) {
+    cv::Mat img(16, 16, CV_8UC1, cv::Scalar(5));
+    std::vector<sample_reason_t> reasons = {
+        {"ENTROPYCONFIDENCE", 0.9f, 0.4f},
+        {"MARGINCONFIDENCE", 0.8f, 0.1f},
+    };
+    SampleWriter writer(config);
+    EXPECT_TRUE(writer.enqueue(img, testPath, reasons));
+    EXPECT_FALSE(writer.enqueue(img, testPath, std::vector<sample_reason_t>()));
+    writer.stop();
+    EXPECT_EQ(writer.getWrittenCount(), 1u);
+    EXPECT_TRUE(boost::filesystem::exists(testPath + "/ENTROPYCONFIDENCE0001.png"));
+
+    std::ifstream manifest(testPath + "/manifest.csv");
+    std::string line;
+    ASSERT_TRUE(std::getline(manifest, line));
+    EXPECT_EQ(line.find("ENTROPYCONFIDENCE0001.png,"), 0u);
+    EXPECT_NE(line.find("ENTROPYCONFIDENCE=0.9/0.4;MARGINCONFIDENCE=0.8/0.1"), std::string::npos);
+    EXPECT_FALSE(std::getline(manifest, line));
+}
+
+// Test the raw codec layout
+TEST_F(SampleWriterTest, RawCodec) {
+    config.codec = SAMPLE_CODEC_RAW;
+    cv::Mat img(4, 5, CV_8UC1, cv::Scalar(7));
+    SampleWriter writer(config);
+    EXPECT_TRUE(writer.enqueue(img, testPath, "RAW"));
+    writer.stop();
+    EXPECT_EQ(boost::filesystem::file_size(testPath + "/RAW0001.raw"), 3 * sizeof(int32_t) + 20u);
+}
+
+// Test the newest-drop policy rejects samples once the queue is full
+TEST_F(SampleWriterTest, DropsWhenFull) {
+    config.queue_size = 2;
+    cv::Mat img(512, 512, CV_8UC3, cv::Scalar(9, 9, 9));
+    SampleWriter writer(config);
+    int queued = 0;
+    for (int i = 0; i < 64; ++i) {
+        queued += writer.enqueue(img, testPath, "FULL") ? 1 : 0;
+    }
+    writer.stop();
+    EXPECT_EQ(writer.getWrittenCount() + writer.getDroppedCount(), 64u);
+    EXPECT_EQ(writer.getWrittenCount(), static_cast<uint64_t>(queued));
+}
+
+// Test a failed write is counted as failed and gets no manifest line
+TEST_F(SampleWriterTest, FailedWriteNotCounted) {
+    // The encoder rejects an empty image
+    cv::Mat empty;
+    cv::Mat img(16, 16, CV_8UC1, cv::Scalar(5));
+    std::vector<sample_reason_t> reasons = {{"BROKEN", 0.9f, 0.4f}};
+    SampleWriter writer(config);
+    EXPECT_TRUE(writer.enqueue(empty, testPath, reasons));
+    EXPECT_TRUE(writer.enqueue(img, testPath, reasons));
+    writer.stop();
+    EXPECT_EQ(writer.getWrittenCount(), 1u);
+    EXPECT_EQ(writer.getFailedCount(), 1u);
+    EXPECT_FALSE(boost::filesystem::exists(testPath + "/BROKEN0001.png"));
+
+    std::ifstream manifest(testPath + "/manifest.csv");
+    std::string line;
+    ASSERT_TRUE(std::getline(manifest, line));
+    EXPECT_EQ(line.find("BROKEN0002.png,"), 0u);
+    EXPECT_FALSE(std::getline(manifest, line));
+}
@@ -4,8 +4,17 @@
 #include <thread>
 #include <chrono>
 #include <vector>
+#include <memory>
 #include <algorithm>
+#include <limits>
+#include <cstring>
+#include <csignal>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <kll_sketch.hpp>
+#include "sharded_sketch.h"
+#include "sketch_container.h"
+#include <frequent_items_sketch.hpp>
 
 typedef datasketches::kll_sketch<float> distributionBox;
 
@@ -26,6 +35,13 @@ protected:
     }
 };
 
+// One save cycle of a single saver, committed as the scheduler would
+static void runCycle(Saver &saver) {
+    std::vector<Saver::pending_write_t> pending;
+    saver.RunCycle(pending);
+    Saver::CommitWrites(pending);
+}
+
 TEST_F(SaverTest, AddObjectToSave) {
     Saver saver(5, "SaverTest"); // Save interval of 5 minutes
     distributionBox noiseBox;
@@ -57,3 +73,510 @@ TEST_F(SaverTest, StartSavingAndTriggerSave) {
 //    EXPECT_EQ(u.get_min_item(), "42");
 }
 
+
+TEST_F(SaverTest, SavesMergedShards) {
+    Saver saver(5, "SaverTest");
+    ShardedSketch<distributionBox> noiseBox(distributionBox(200), 4);
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 3; ++t) {
+        producers.emplace_back([&noiseBox, t] {
+            for (int i = 0; i < 1000; ++i) {
+                noiseBox.update(static_cast<float>(t * 1000 + i));
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+
+    saver.AddObjectToSave((void*)(&noiseBox), SHARDED_KLL_TYPE, testFilename);
+    saver.StartSaving();
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    saver.StopSaving();
+
+    std::ifstream is(testFilename, std::ios::binary);
+    auto saved = datasketches::kll_sketch<float>::deserialize(is);
+    EXPECT_EQ(saved.get_n(), 3000u);
+    EXPECT_FLOAT_EQ(saved.get_min_item(), 0.0f);
+    EXPECT_FLOAT_EQ(saved.get_max_item(), 2999.0f);
+}
+
+TEST_F(SaverTest, SavesConsistentSnapshotWhileUpdating) {
+    Saver saver(1, "SaverTest");
+    ShardedSketch<distributionBox> noiseBox(distributionBox(200), 2);
+    std::atomic<bool> done(false);
+    std::atomic<uint64_t> updates(0);
+    std::thread producer([&] {
+        while (!done.load()) {
+            noiseBox.update(static_cast<float>(updates.fetch_add(1) % 100));
+        }
+    });
+
+    saver.AddObjectToSave((void*)(&noiseBox), SHARDED_KLL_TYPE, testFilename);
+    saver.StartSaving();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    saver.StopSaving();
+    done.store(true);
+    producer.join();
+
+    std::ifstream is(testFilename, std::ios::binary);
+    auto saved = datasketches::kll_sketch<float>::deserialize(is);
+    EXPECT_GT(saved.get_n(), 0u);
+    EXPECT_LE(saved.get_n(), updates.load());
+    EXPECT_GE(saved.get_min_item(), 0.0f);
+    EXPECT_LE(saved.get_max_item(), 99.0f);
+}
+
+TEST_F(SaverTest, WritesChecksummedFileAtomically) {
+    saver_config_t config = defaultSaverConfig();
+    Saver saver(5, "SaverTest", config);
+    distributionBox noiseBox;
+    for (int i = 0; i < 100; ++i) {
+        noiseBox.update(static_cast<float>(i));
+    }
+    saver.AddObjectToSave((void*)(&noiseBox), KLL_TYPE, testFilename);
+    saver.StartSaving();
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    saver.StopSaving();
+
+    std::ifstream tmp(testFilename + ".tmp");
+    EXPECT_FALSE(tmp.is_open());  // The temp file was renamed over the target
+
+    std::vector<uint8_t> payload;
+    ASSERT_TRUE(readSavedObject(testFilename, payload));
+    auto saved = datasketches::kll_sketch<float>::deserialize(payload.data(), payload.size());
+    EXPECT_EQ(saved.get_n(), 100u);
+
+    // Flip one payload byte: the footer must reject the file
+    std::fstream fs(testFilename, std::ios::in | std::ios::out | std::ios::binary);
+    fs.seekp(10);
+    fs.put(static_cast<char>(payload[10] ^ 0xFF));
+    fs.close();
+    EXPECT_FALSE(readSavedObject(testFilename, payload));
+}
+
+TEST_F(SaverTest, ParseSaverConfig) {
+    std::map<std::string, std::string> config = {{"save_sync", "file"}, {"NOISE", "0.5"}};
+    saver_config_t parsed = parseSaverConfig(config);
+    EXPECT_EQ(parsed.sync_policy, SAVER_SYNC_FILE);
+    EXPECT_EQ(config.count("save_sync"), 0u);  // Consumed so metric loops do not see it
+    EXPECT_EQ(config.size(), 1u);
+}
+
+TEST_F(SaverTest, SkipsUnchangedObjects) {
+    Saver saver(1, "SaverTest");
+    ShardedSketch<distributionBox> noiseBox(distributionBox(200), 2);
+    noiseBox.update(1.0f);
+    saver.AddObjectToSave((void*)(&noiseBox), SHARDED_KLL_TYPE, testFilename);
+    saver.StartSaving();
+    std::this_thread::sleep_for(std::chrono::milliseconds(2500));  // First write plus at least one idle cycle
+
+    uint64_t written = saver.GetTotalBytesWritten();
+    EXPECT_GT(written, 0u);
+    EXPECT_GE(saver.GetSkippedCount(), 1u);
+    EXPECT_EQ(saver.GetLastCycleBytes(), 0u);
+
+    noiseBox.update(2.0f);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    saver.StopSaving();
+    EXPECT_GT(saver.GetTotalBytesWritten(), written);
+
+    std::vector<uint8_t> payload;
+    ASSERT_TRUE(readSavedObject(testFilename, payload));
+    EXPECT_EQ(datasketches::kll_sketch<float>::deserialize(payload.data(), payload.size()).get_n(), 2u);
+}
+
+TEST_F(SaverTest, LogModeAppendsDeltas) {
+    saver_config_t config = defaultSaverConfig();
+    config.mode = SAVER_MODE_LOG;
+    Saver saver(1, "SaverTest", config);
+    ShardedSketch<distributionBox> noiseBox(distributionBox(200), 2);
+    for (int i = 0; i < 10; ++i) {
+        noiseBox.update(static_cast<float>(i));
+    }
+    saver.AddObjectToSave((void*)(&noiseBox), SHARDED_KLL_TYPE, testFilename);
+    saver.StartSaving();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    for (int i = 0; i < 5; ++i) {
+        noiseBox.update(100.0f + i);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    saver.StopSaving();
+    std::string segment = saver.objects_to_save_.front()->segment;
+
+    EXPECT_EQ(noiseBox.snapshot().get_n(), 0u);  // Drained into the log
+
+    // A torn append at the tail must not hide the complete records
+    std::ofstream torn(segment, std::ios::binary | std::ios::app);
+    torn << "DTL1\x10";
+    torn.close();
+
+    std::vector<sketch_log_record_t> records;
+    ASSERT_EQ(readSketchLog(testFilename, 0, std::numeric_limits<time_t>::max(), records), 2u);
+    EXPECT_LE(records[0].end, records[1].start);
+    distributionBox first = distributionBox::deserialize(records[0].payload.data(), records[0].payload.size());
+    EXPECT_EQ(first.get_n(), 10u);
+
+    distributionBox merged = mergeSketchLog(testFilename, 0, std::numeric_limits<time_t>::max(), distributionBox(200));
+    EXPECT_EQ(merged.get_n(), 15u);
+    EXPECT_FLOAT_EQ(merged.get_max_item(), 104.0f);
+
+    std::remove(segment.c_str());
+}
+
+static off_t fileSize(const std::string &filename) {
+    struct stat st;
+    return stat(filename.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+TEST_F(SaverTest, LogModeRecoversFromFailedAppend) {
+    saver_config_t config = defaultSaverConfig();
+    config.mode = SAVER_MODE_LOG;
+    Saver saver(3600, "SaverTest", config);
+    ShardedSketch<distributionBox> noiseBox(distributionBox(200), 2);
+    saver.AddObjectToSave(&noiseBox, testFilename);
+    for (int i = 0; i < 10; ++i) {
+        noiseBox.update(static_cast<float>(i));
+    }
+    runCycle(saver);
+    const std::string segment = saver.objects_to_save_.front()->segment;
+    const off_t good = fileSize(segment);
+    ASSERT_GT(good, 0);
+
+    // Let only part of the next record reach the file
+    for (int i = 0; i < 5; ++i) {
+        noiseBox.update(100.0f + i);
+    }
+    struct rlimit saved_limit;
+    ASSERT_EQ(getrlimit(RLIMIT_FSIZE, &saved_limit), 0);
+    void (*saved_handler)(int) = signal(SIGXFSZ, SIG_IGN);
+    struct rlimit limit = saved_limit;
+    limit.rlim_cur = good + 16;
+    ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &limit), 0);
+    runCycle(saver);
+    setrlimit(RLIMIT_FSIZE, &saved_limit);
+    signal(SIGXFSZ, saved_handler);
+    EXPECT_EQ(saver.GetLastCycleBytes(), 0u);
+    EXPECT_EQ(fileSize(segment), good);  // The torn record was cut off
+    EXPECT_EQ(noiseBox.snapshot().get_n(), 0u);  // Drained, but kept by the saver
+
+    // The next append lands after the first record and carries the lost delta too
+    for (int i = 0; i < 3; ++i) {
+        noiseBox.update(200.0f + i);
+    }
+    runCycle(saver);
+    EXPECT_GT(saver.GetLastCycleBytes(), 0u);
+
+    std::vector<sketch_log_record_t> records;
+    ASSERT_EQ(readSketchLog(testFilename, 0, std::numeric_limits<time_t>::max(), records), 2u);
+    EXPECT_EQ(records[0].end, records[1].start);  // The failed append did not move the window
+    distributionBox second = distributionBox::deserialize(records[1].payload.data(), records[1].payload.size());
+    EXPECT_EQ(second.get_n(), 8u);
+    EXPECT_FLOAT_EQ(second.get_min_item(), 100.0f);
+    distributionBox merged = mergeSketchLog(testFilename, 0, std::numeric_limits<time_t>::max(), distributionBox(200));
+    EXPECT_EQ(merged.get_n(), 18u);
+
+    std::remove(segment.c_str());
+}
+
+TEST_F(SaverTest, ContainerModeWritesOneFile) {
+    saver_config_t config = defaultSaverConfig();
+    config.mode = SAVER_MODE_CONTAINER;
+    config.container_path = "test_sketches.dtc";
+    Saver saver(1, "SaverTest", config);
+    ShardedSketch<distributionBox> noiseBox(distributionBox(200), 2);
+    ShardedSketch<distributionBox> meanBox(distributionBox(200), 2);
+    datasketches::frequent_items_sketch<std::string> classes(6);
+    for (int i = 0; i < 50; ++i) {
+        noiseBox.update(static_cast<float>(i));
+    }
+    meanBox.update(7.0f);
+    classes.update("cat", 3);
+    saver.AddObjectToSave((void*)(&noiseBox), SHARDED_KLL_TYPE, "./noise.bin");
+    saver.AddObjectToSave((void*)(&meanBox), SHARDED_KLL_TYPE, "./mean_0.bin");
+    saver.AddObjectToSave((void*)(&classes), FI_TYPE, "./classes.bin");
+    saver.StartSaving();
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    saver.StopSaving();
+
+    std::ifstream separate("noise.bin");
+    EXPECT_FALSE(separate.is_open());  // Nothing is written outside the container
+
+    SketchContainer container;
+    ASSERT_TRUE(container.open("test_sketches.dtc"));
+    EXPECT_EQ(container.size(), 3u);
+    std::vector<std::string> expected = {"classes.bin", "mean_0.bin", "noise.bin"};
+    EXPECT_EQ(container.names(), expected);
+
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    int type = -1;
+    ASSERT_TRUE(container.find("noise.bin", &data, &size, &type));
+    EXPECT_EQ(type, SHARDED_KLL_TYPE);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(data) % 8, 0u);  // Blobs are aligned inside the mapping
+    EXPECT_EQ(distributionBox::deserialize(data, size).get_n(), 50u);
+    ASSERT_TRUE(container.find("classes.bin", &data, &size));
+    EXPECT_EQ(datasketches::frequent_items_sketch<std::string>::deserialize(data, size).get_estimate("cat"), 3u);
+    EXPECT_FALSE(container.find("pixel_0.bin", &data, &size));
+    container.close();
+    std::remove("test_sketches.dtc");
+}
+
+TEST_F(SaverTest, ContainerModeRejectsDuplicateNames) {
+    saver_config_t config = defaultSaverConfig();
+    config.mode = SAVER_MODE_CONTAINER;
+    config.container_path = "test_sketches.dtc";
+    Saver saver(3600, "SaverTest", config);
+    ShardedSketch<distributionBox> noiseBox(distributionBox(200), 2);
+    ShardedSketch<distributionBox> otherNoiseBox(distributionBox(200), 2);
+    noiseBox.update(1.0f);
+    otherNoiseBox.update(2.0f);
+    otherNoiseBox.update(3.0f);
+    saver.AddObjectToSave(&noiseBox, "./noise.bin");
+    saver.AddObjectToSave(&otherNoiseBox, "/tmp/noise.bin");  // Same entry name, other directory
+    EXPECT_EQ(saver.objects_to_save_.size(), 1u);
+
+    runCycle(saver);
+    SketchContainer container;
+    ASSERT_TRUE(container.open("test_sketches.dtc"));
+    EXPECT_EQ(container.size(), 1u);
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    ASSERT_TRUE(container.find("noise.bin", &data, &size));
+    EXPECT_EQ(distributionBox::deserialize(data, size).get_n(), 1u);
+    container.close();
+    std::remove("test_sketches.dtc");
+
+    // The encoder keeps the first of two entries with one name
+    const uint8_t first[] = {1, 2, 3};
+    const uint8_t second[] = {4, 5};
+    std::vector<sketch_container_entry_t> entries = {
+        {"b.bin", KLL_TYPE, second, sizeof(second)},
+        {"a.bin", KLL_TYPE, first, sizeof(first)},
+        {"b.bin", FI_TYPE, first, sizeof(first)},
+    };
+    std::vector<uint8_t> image;
+    encodeSketchContainer(entries, image);
+    std::ofstream("test_sketches.dtc", std::ios::binary).write(reinterpret_cast<const char *>(image.data()), image.size());
+    ASSERT_TRUE(container.open("test_sketches.dtc"));
+    std::vector<std::string> expected = {"a.bin", "b.bin"};
+    EXPECT_EQ(container.names(), expected);
+    int type = -1;
+    ASSERT_TRUE(container.find("b.bin", &data, &size, &type));
+    EXPECT_EQ(type, KLL_TYPE);
+    EXPECT_EQ(size, sizeof(second));
+    container.close();
+    std::remove("test_sketches.dtc");
+}
+
+// A type the saver has no tag for, registered through ISerializable
+class CounterSerializable : public ISerializable {
+public:
+    uint64_t count = 0;
+    int released = 0;
+    uint64_t generation() const override { return count; }
+    bool supports_drain() const override { return false; }
+    bool prepare(bool) override { frozen_ = count; return true; }
+    size_t serialized_size() const override { return sizeof(frozen_); }
+    size_t serialize_into(uint8_t *dst, size_t capacity) const override {
+        if (capacity < sizeof(frozen_)) return 0;
+        memcpy(dst, &frozen_, sizeof(frozen_));
+        return sizeof(frozen_);
+    }
+    void release(bool) override { released++; }
+private:
+    uint64_t frozen_ = 0;
+};
+
+TEST_F(SaverTest, SerializesTypedObjectsIntoOneArena) {
+    Saver saver(1, "SaverTest");
+    ShardedSketch<distributionBox> noiseBox(distributionBox(200), 2);
+    datasketches::frequent_items_sketch<std::string> classes(6);
+    CounterSerializable *counter = new CounterSerializable;
+    for (int i = 0; i < 20; ++i) {
+        noiseBox.update(static_cast<float>(i));
+    }
+    classes.update("dog", 2);
+    counter->count = 42;
+    saver.AddObjectToSave(&noiseBox, "test_noise.bin");
+    saver.AddObjectToSave(&classes, "test_classes.bin");
+    saver.AddSerializable(counter, TYPE_MAX, "test_counter.bin");
+    EXPECT_EQ(saver.objects_to_save_.front()->type, SHARDED_KLL_TYPE);
+
+    runCycle(saver);
+    size_t arena = 0;
+    for (const auto &item : saver.items_) {
+        arena += item.size;
+    }
+    EXPECT_EQ(saver.items_.size(), 3u);
+    EXPECT_EQ(saver.arena_.size(), arena);  // Sized once for the whole cycle
+    EXPECT_EQ(saver.GetLastCycleBytes(), arena);
+    EXPECT_EQ(counter->released, 1);  // The frozen state is freed once written
+
+    std::vector<uint8_t> payload;
+    ASSERT_TRUE(readSavedObject("test_noise.bin", payload));
+    EXPECT_EQ(distributionBox::deserialize(payload.data(), payload.size()).get_n(), 20u);
+    ASSERT_TRUE(readSavedObject("test_classes.bin", payload));
+    EXPECT_EQ(datasketches::frequent_items_sketch<std::string>::deserialize(payload.data(), payload.size())
+              .get_estimate("dog"), 2u);
+    ASSERT_TRUE(readSavedObject("test_counter.bin", payload));
+    ASSERT_EQ(payload.size(), sizeof(uint64_t));
+    uint64_t value = 0;
+    memcpy(&value, payload.data(), sizeof(value));
+    EXPECT_EQ(value, 42u);
+
+    // A smaller cycle reuses the arena instead of reallocating it
+    const uint8_t *buffer = saver.arena_.data();
+    counter->count = 43;
+    runCycle(saver);
+    EXPECT_EQ(saver.items_.size(), 1u);
+    EXPECT_EQ(saver.arena_.data(), buffer);
+
+    std::remove("test_noise.bin");
+    std::remove("test_classes.bin");
+    std::remove("test_counter.bin");
+}
+
+TEST_F(SaverTest, TriggerWakesAndStopReturnsPromptly) {
+    Saver saver(3600, "SaverTest");
+    ShardedSketch<distributionBox> noiseBox(distributionBox(200), 2);
+    noiseBox.update(1.0f);
+    saver.AddObjectToSave(&noiseBox, testFilename);
+    saver.StartSaving();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));  // First cycle, then an hour-long wait
+    uint64_t written = saver.GetTotalBytesWritten();
+    EXPECT_GT(written, 0u);
+
+    noiseBox.update(2.0f);
+    saver.TriggerSave();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_GT(saver.GetTotalBytesWritten(), written);
+
+    auto start = std::chrono::steady_clock::now();
+    saver.StopSaving();
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(100));
+}
+
+TEST_F(SaverTest, SubSecondInterval) {
+    std::map<std::string, std::string> ini = {{"save_interval_ms", "50"}};
+    Saver saver(3600, "SaverTest", parseSaverConfig(ini));
+    EXPECT_EQ(saver.save_interval_, std::chrono::milliseconds(50));
+    ShardedSketch<distributionBox> noiseBox(distributionBox(200), 2);
+    saver.AddObjectToSave(&noiseBox, testFilename);
+    saver.StartSaving();
+    for (int i = 0; i < 5; ++i) {
+        noiseBox.update(static_cast<float>(i));
+        std::this_thread::sleep_for(std::chrono::milliseconds(120));
+    }
+    saver.StopSaving();
+
+    std::vector<uint8_t> payload;
+    ASSERT_TRUE(readSavedObject(testFilename, payload));
+    EXPECT_EQ(distributionBox::deserialize(payload.data(), payload.size()).get_n(), 5u);
+}
+
+TEST_F(SaverTest, BatchCommitsSeveralSavers) {
+    Saver first(3600, "SaverTestA");
+    Saver second(3600, "SaverTestB");
+    ShardedSketch<distributionBox> noiseBox(distributionBox(200), 2);
+    ShardedSketch<distributionBox> meanBox(distributionBox(200), 2);
+    noiseBox.update(1.0f);
+    meanBox.update(2.0f);
+    first.AddObjectToSave(&noiseBox, "test_noise.bin");
+    second.AddObjectToSave(&meanBox, "test_mean.bin");
+
+    // Cycles only write temp files; nothing is renamed before the batch commit
+    std::vector<Saver::pending_write_t> batch;
+    first.RunCycle(batch);
+    second.RunCycle(batch);
+    ASSERT_EQ(batch.size(), 2u);
+    std::ifstream early("test_noise.bin");
+    EXPECT_FALSE(early.is_open());
+
+    EXPECT_EQ(Saver::CommitWrites(batch), 2u);
+    std::vector<uint8_t> payload;
+    ASSERT_TRUE(readSavedObject("test_noise.bin", payload));
+    EXPECT_EQ(distributionBox::deserialize(payload.data(), payload.size()).get_n(), 1u);
+    ASSERT_TRUE(readSavedObject("test_mean.bin", payload));
+    EXPECT_EQ(distributionBox::deserialize(payload.data(), payload.size()).get_n(), 1u);
+    EXPECT_GT(first.GetLastCycleBytes(), 0u);
+    EXPECT_GT(second.GetLastCycleBytes(), 0u);
+    EXPECT_EQ(first.GetTotalBytesWritten() + second.GetTotalBytesWritten(),
+              first.GetLastCycleBytes() + second.GetLastCycleBytes());
+
+    // Both objects were marked written, so the next cycle skips them
+    batch.clear();
+    first.RunCycle(batch);
+    second.RunCycle(batch);
+    EXPECT_TRUE(batch.empty());
+    std::remove("test_noise.bin");
+    std::remove("test_mean.bin");
+}
+
+TEST_F(SaverTest, BatchCommitsMoreFilesThanDescriptorLimit) {
+    const size_t kFiles = 100;
+    Saver first(3600, "SaverTestA");
+    Saver second(3600, "SaverTestB");
+    std::vector<std::unique_ptr<ShardedSketch<distributionBox>>> boxes;
+    std::vector<std::string> names;
+    for (size_t i = 0; i < kFiles; ++i) {
+        boxes.emplace_back(new ShardedSketch<distributionBox>(distributionBox(200), 2));
+        boxes.back()->update(static_cast<float>(i));
+        names.push_back("test_batch_" + std::to_string(i) + ".bin");
+        (i % 2 == 0 ? first : second).AddObjectToSave(boxes.back().get(), names.back());
+    }
+
+    // Far fewer descriptors than the batch has files
+    struct rlimit saved_limit;
+    ASSERT_EQ(getrlimit(RLIMIT_NOFILE, &saved_limit), 0);
+    struct rlimit limit = saved_limit;
+    limit.rlim_cur = 32;
+    ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &limit), 0);
+    std::vector<Saver::pending_write_t> batch;
+    first.RunCycle(batch);
+    second.RunCycle(batch);
+    const size_t written = batch.size();
+    const size_t committed = Saver::CommitWrites(batch);
+    setrlimit(RLIMIT_NOFILE, &saved_limit);
+    EXPECT_EQ(written, kFiles);
+    EXPECT_EQ(committed, kFiles);
+
+    std::vector<uint8_t> payload;
+    for (size_t i = 0; i < kFiles; ++i) {
+        ASSERT_TRUE(readSavedObject(names[i], payload)) << names[i];
+        distributionBox saved = distributionBox::deserialize(payload.data(), payload.size());
+        EXPECT_EQ(saved.get_n(), 1u);
+        EXPECT_FLOAT_EQ(saved.get_min_item(), static_cast<float>(i));
+        std::remove(names[i].c_str());
+    }
+}
+
+TEST_F(SaverTest, SharedSchedulerFlushBarrier) {
+    Saver first(3600, "SaverTestA");
+    Saver second(3600, "SaverTestB");
+    ShardedSketch<distributionBox> noiseBox(distributionBox(200), 2);
+    ShardedSketch<distributionBox> meanBox(distributionBox(200), 2);
+    first.AddObjectToSave(&noiseBox, "test_noise.bin");
+    second.AddObjectToSave(&meanBox, "test_mean.bin");
+    first.StartSaving();
+    second.StartSaving();
+    EXPECT_EQ(SaveScheduler::instance().registered(), 2u);
+
+    noiseBox.update(1.0f);
+    meanBox.update(2.0f);
+    meanBox.update(3.0f);
+    SaveScheduler::instance().flush();  // Both savers wrote the updates above
+
+    std::vector<uint8_t> payload;
+    ASSERT_TRUE(readSavedObject("test_noise.bin", payload));
+    EXPECT_EQ(distributionBox::deserialize(payload.data(), payload.size()).get_n(), 1u);
+    ASSERT_TRUE(readSavedObject("test_mean.bin", payload));
+    EXPECT_EQ(distributionBox::deserialize(payload.data(), payload.size()).get_n(), 2u);
+
+    first.StopSaving();
+    second.StopSaving();
+    EXPECT_EQ(SaveScheduler::instance().registered(), 0u);
+    EXPECT_FALSE(first.IsSaving());
+    std::remove("test_noise.bin");
+    std::remove("test_mean.bin");
+}
@@ -112,7 +112,7 @@ TEST(DecompressionAndUnpackTest, DecompressAndUnpack) {
             }
             snprintf(header.chksum, sizeof(header.chksum), "%06o", checksum);
 
-            tarFile.write(reinterpret_cast<char*>(&header), sizeof(header));
+            tarFile.write(reinterpret_cast<char*>(&header), T_BLOCKSIZE);
             tarFile.write(buffer.data(), buffer.size());
         }
 
@@ -160,3 +160,82 @@ TEST(DecompressionAndUnpackTest, DecompressAndUnpack) {
     fs::remove(tarFilePath);
     fs::remove(gzFilePath);
 }
+
+// Test streaming a folder straight into a .tar.gz and reading it back
+TEST(TarGzCreatorTest, CreateTarGzStreams) {
+    TarGzCreator creator;
+    std::string testFolder = "stream_folder";
+    std::string gzFilePath = "stream.tar.gz";
+    std::string outputFolderPath = "stream_unpacked";
+    fs::create_directories(testFolder + "/nested");
+
+    // Larger than one read chunk and not a multiple of the tar block size
+    std::string large(200 * 1024 + 7, 'x');
+    for (size_t i = 0; i < large.size(); i += 97) {
+        large[i] = static_cast<char>('a' + i % 26);
+    }
+    std::ofstream(testFolder + "/large.bin", std::ios::binary) << large;
+    std::ofstream(testFolder + "/nested/small.txt") << "small";
+    std::ofstream(testFolder + "/empty.txt").close();
+
+    std::vector<std::string> files = creator.collectFilesFromFolders({testFolder});
+    ASSERT_EQ(files.size(), 3u);
+    ASSERT_TRUE(creator.createTarGz(gzFilePath, files));
+    ASSERT_FALSE(fs::exists(gzFilePath + ".tar"));
+
+    ASSERT_TRUE(creator.decompressGz(gzFilePath, "stream.tar"));
+    EXPECT_EQ(fs::file_size("stream.tar") % T_BLOCKSIZE, 0u);
+    ASSERT_TRUE(creator.unpackTar("stream.tar", outputFolderPath));
+
+    std::ifstream extracted(outputFolderPath + "/" + testFolder + "/large.bin", std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(extracted)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(content, large);
+    std::ifstream small(outputFolderPath + "/" + testFolder + "/nested/small.txt");
+    std::string smallContent((std::istreambuf_iterator<char>(small)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(smallContent, "small");
+    EXPECT_TRUE(fs::exists(outputFolderPath + "/" + testFolder + "/empty.txt"));
+
+    fs::remove_all(testFolder);
+    fs::remove_all(outputFolderPath);
+    fs::remove(gzFilePath);
+    fs::remove("stream.tar");
+}
+
+// Test that the parallel gzip output decompresses to exactly the tar stream
+TEST(TarGzCreatorTest, ParallelGzMatchesTar) {
+    TarGzCreator creator;
+    std::string testFolder = "parallel_folder";
+    fs::create_directory(testFolder);
+    std::string data;
+    for (unsigned long i = 0; i < 300000; ++i) {
+        data += std::to_string(i * 7919 % 1000) + ",";
+    }
+    std::ofstream(testFolder + "/values.csv", std::ios::binary) << data;
+    std::ofstream(testFolder + "/short.txt") << "short";
+    std::vector<std::string> files = creator.collectFilesFromFolders({testFolder});
+
+    ASSERT_TRUE(creator.createTar("parallel.tar", files));
+    // Small blocks so the stream spans many independently deflated blocks
+    ASSERT_TRUE(creator.compressToGzParallel("parallel.tar", "parallel.tar.gz", 4, Z_DEFAULT_COMPRESSION, 32 * 1024));
+    ASSERT_TRUE(creator.decompressGz("parallel.tar.gz", "parallel_out.tar"));
+
+    std::ifstream expected("parallel.tar", std::ios::binary);
+    std::ifstream actual("parallel_out.tar", std::ios::binary);
+    std::string expectedBytes((std::istreambuf_iterator<char>(expected)), std::istreambuf_iterator<char>());
+    std::string actualBytes((std::istreambuf_iterator<char>(actual)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(actualBytes, expectedBytes);
+    EXPECT_LT(fs::file_size("parallel.tar.gz"), expectedBytes.size() / 2);
+
+    ASSERT_TRUE(creator.createTarGzParallel("parallel2.tar.gz", files, 3));
+    ASSERT_TRUE(creator.decompressGz("parallel2.tar.gz", "parallel2.tar"));
+    ASSERT_TRUE(creator.unpackTar("parallel2.tar", "parallel_unpacked"));
+    std::ifstream extracted("parallel_unpacked/" + testFolder + "/values.csv", std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(extracted)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(content, data);
+
+    fs::remove_all(testFolder);
+    fs::remove_all("parallel_unpacked");
+    for (const char *file : {"parallel.tar", "parallel.tar.gz", "parallel_out.tar", "parallel2.tar.gz", "parallel2.tar"}) {
+        fs::remove(file);
+    }
+}
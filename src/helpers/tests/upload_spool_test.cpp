@@ -0,0 +1,201 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include "upload_spool.h"
+#include "http_uploader.h"
+#include "loopback_http_server.h"
+
+static int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+class UploadSpoolTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        journal_ = "test_upload_spool.journal";
+        std::remove(journal_.c_str());
+        files_ = {"test_spool_a.bin", "test_spool_b.bin", "test_spool_c.bin"};
+        for (const auto& file : files_) {
+            std::ofstream(file, std::ios::binary) << "spooled " << file;
+        }
+        config_ = defaultUploadSpoolConfig();
+        config_.base_backoff_ms = 40;
+        config_.max_backoff_ms = 200;
+    }
+
+    void TearDown() override {
+        std::remove(journal_.c_str());
+        for (const auto& file : files_) {
+            std::remove(file.c_str());
+        }
+    }
+
+    std::string journal_;
+    std::vector<std::string> files_;
+    upload_spool_config_t config_;
+};
+
+// A version marked done is not handed out again until the file changes
+TEST_F(UploadSpoolTest, DoneIsNotResent) {
+    UploadSpool spool(journal_, config_);
+    ASSERT_TRUE(spool.open());
+    EXPECT_TRUE(spool.enqueue(files_[0], "00.00.00", 1));
+    EXPECT_FALSE(spool.enqueue(files_[0], "00.00.00", 1));  // Already queued
+
+    std::vector<spool_entry_t> batch = spool.due();
+    ASSERT_EQ(batch.size(), 1u);
+    EXPECT_TRUE(spool.due().empty());  // In flight
+    spool.markDone(batch[0]);
+    spool.markDone(batch[0]);
+    EXPECT_EQ(spool.done(), 1u);
+    EXPECT_EQ(spool.pending(), 0u);
+
+    EXPECT_FALSE(spool.enqueue(files_[0], "00.00.00", 2));
+    EXPECT_TRUE(spool.due().empty());
+
+    std::ofstream(files_[0], std::ios::binary | std::ios::app) << " changed";
+    EXPECT_TRUE(spool.enqueue(files_[0], "00.00.00", 3));
+    EXPECT_EQ(spool.due().size(), 1u);
+}
+
+// Failures back off exponentially with jitter, up to the cap
+TEST_F(UploadSpoolTest, BackoffGrowsWithJitter) {
+    UploadSpool spool(journal_, config_);
+    ASSERT_TRUE(spool.open());
+    ASSERT_TRUE(spool.enqueue(files_[0], "00.00.00", 1));
+
+    spool_entry_t entry;
+    int64_t expected[] = {40, 80, 160, 200, 200};
+    for (int64_t delay : expected) {
+        spool_entry_t failing;
+        ASSERT_TRUE(spool.find(files_[0], failing));
+        int64_t before = nowMs();
+        spool.markFailed(failing);
+        int64_t after = nowMs();
+        ASSERT_TRUE(spool.find(files_[0], entry));
+        EXPECT_GE(entry.next_attempt_ms, before + delay / 2);
+        EXPECT_LE(entry.next_attempt_ms, after + delay);
+    }
+    EXPECT_EQ(entry.attempts, 5u);
+    EXPECT_TRUE(spool.due().empty());
+    EXPECT_GT(spool.nextDueMs(), 0);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(210));
+    EXPECT_EQ(spool.nextDueMs(), 0);
+    EXPECT_EQ(spool.due().size(), 1u);
+
+    config_.max_attempts = 1;
+    UploadSpool limited(journal_ + ".limited", config_);
+    ASSERT_TRUE(limited.open());
+    ASSERT_TRUE(limited.enqueue(files_[1], "00.00.00", 1));
+    limited.markFailed(limited.due()[0]);
+    EXPECT_EQ(limited.pending(), 0u);
+    std::remove((journal_ + ".limited").c_str());
+}
+
+// Reopening the journal restores pending, failed and done entries; in-flight ones are pending again
+TEST_F(UploadSpoolTest, RecoversAfterRestart) {
+    {
+        UploadSpool spool(journal_, config_);
+        ASSERT_TRUE(spool.open());
+        for (const auto& file : files_) {
+            ASSERT_TRUE(spool.enqueue(file, "00.00.00", 7));
+        }
+        std::vector<spool_entry_t> batch = spool.due();
+        ASSERT_EQ(batch.size(), 3u);
+        spool.markDone(batch[0]);
+        spool.markFailed(batch[1]);
+        // batch[2] is still uploading when the process dies
+    }
+    // A record torn by the crash
+    std::ofstream(journal_, std::ios::app) << "D\t12\t3";
+
+    UploadSpool spool(journal_, config_);
+    ASSERT_TRUE(spool.open());
+    EXPECT_EQ(spool.done(), 1u);
+    EXPECT_EQ(spool.pending(), 2u);
+    EXPECT_FALSE(spool.enqueue(files_[0], "00.00.00", 7));
+
+    spool_entry_t entry;
+    ASSERT_TRUE(spool.find(files_[1], entry));
+    EXPECT_EQ(entry.attempts, 1u);
+    EXPECT_EQ(entry.timestamp, 7);
+    EXPECT_EQ(entry.sensorId, "00.00.00");
+    ASSERT_TRUE(spool.find(files_[2], entry));
+    EXPECT_EQ(entry.attempts, 0u);
+    EXPECT_FALSE(entry.in_flight);
+
+    std::vector<spool_entry_t> batch = spool.due();
+    ASSERT_EQ(batch.size(), 1u);
+    EXPECT_EQ(batch[0].path, files_[2]);
+
+    // The done entry of a deleted file is forgotten on compaction
+    std::remove(files_[0].c_str());
+    ASSERT_TRUE(spool.compact());
+    EXPECT_EQ(spool.done(), 0u);
+}
+
+// The journal is rewritten once it holds compact_records records
+TEST_F(UploadSpoolTest, CompactsJournal) {
+    config_.compact_records = 16;
+    UploadSpool spool(journal_, config_);
+    ASSERT_TRUE(spool.open());
+    for (int i = 0; i < 50; ++i) {
+        spool.enqueue(files_[0], "00.00.00", i);
+        std::vector<spool_entry_t> batch = spool.due();
+        ASSERT_EQ(batch.size(), 1u);
+        spool.markDone(batch[0]);
+        std::ofstream(files_[0], std::ios::binary | std::ios::app) << i;
+    }
+    EXPECT_LE(spool.records_, 16u);
+
+    UploadSpool reopened(journal_, config_);
+    ASSERT_TRUE(reopened.open());
+    EXPECT_EQ(reopened.done(), 1u);
+}
+
+// Failed uploads are retried until the endpoint recovers, then not sent again
+TEST_F(UploadSpoolTest, RetriesThroughOutage) {
+    LoopbackHttpServer server(503);
+    HttpUploader uploader(server.url(), "dummy_token");
+    UploadSpool spool(journal_, config_);
+    ASSERT_TRUE(spool.open());
+    for (const auto& file : files_) {
+        ASSERT_TRUE(spool.enqueue(file, "00.00.00", 1));
+    }
+
+    auto cycle = [&] {
+        for (const spool_entry_t& entry : spool.due()) {
+            uploader.postFileAsync(entry.path, entry.sensorId, entry.timestamp,
+                                   [&spool, entry](const upload_result_t& result) {
+                                       if (result.ok) {
+                                           spool.markDone(entry);
+                                       } else {
+                                           spool.markFailed(entry);
+                                       }
+                                   });
+        }
+        uploader.waitIdle();
+    };
+
+    cycle();
+    cycle();  // Still backing off, nothing is sent
+    EXPECT_EQ(server.requests(), 3u);
+    EXPECT_EQ(spool.pending(), 3u);
+
+    server.setStatus(200);
+    while (spool.pending() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(std::max<int64_t>(spool.nextDueMs(), 1)));
+        cycle();
+    }
+    EXPECT_EQ(spool.done(), 3u);
+    EXPECT_EQ(server.requests(), 6u);
+
+    cycle();
+    EXPECT_EQ(server.requests(), 6u);
+}
@@ -0,0 +1,423 @@
+#include "upload_spool.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "datatracer_log.h"
+
+// Journal records, one per line, fields separated by tabs with the path last:
+//   P size mtime_ns timestamp attempts next_attempt_ms sensor_id path   pending
+//   D size mtime_ns path                                                  done
+//   X path                                                                forgotten
+
+upload_spool_config_t defaultUploadSpoolConfig() {
+    upload_spool_config_t config;
+    config.base_backoff_ms = 1000;
+    config.max_backoff_ms = 10 * 60 * 1000;
+    config.max_attempts = 0;
+    config.compact_records = 4096;
+    config.sync = false;
+    return config;
+}
+
+static int64_t wallClockMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static bool fileVersion(const std::string &path, uint64_t &size, int64_t &mtime_ns) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    size = static_cast<uint64_t>(st.st_size);
+#ifdef __APPLE__
+    mtime_ns = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+static bool writeAll(int fd, const char *bytes, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = write(fd, bytes + done, size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+static std::string pendingRecord(const spool_entry_t &entry) {
+    std::ostringstream record;
+    record << "P\t" << entry.size << '\t' << entry.mtime_ns << '\t' << static_cast<long long>(entry.timestamp)
+           << '\t' << entry.attempts << '\t' << entry.next_attempt_ms << '\t' << entry.sensorId << '\t'
+           << entry.path << '\n';
+    return record.str();
+}
+
+static std::string doneRecord(const spool_entry_t &entry) {
+    std::ostringstream record;
+    record << "D\t" << entry.size << '\t' << entry.mtime_ns << '\t' << entry.path << '\n';
+    return record.str();
+}
+
+static std::string forgetRecord(const std::string &path) {
+    return "X\t" + path + "\n";
+}
+
+// Splits off count tab separated fields, the rest of the line is the path
+static bool splitRecord(const std::string &line, size_t count, std::vector<std::string> &fields, std::string &path) {
+    fields.clear();
+    size_t start = 2;
+    for (size_t i = 0; i < count; i++) {
+        size_t tab = line.find('\t', start);
+        if (tab == std::string::npos) {
+            return false;
+        }
+        fields.push_back(line.substr(start, tab - start));
+        start = tab + 1;
+    }
+    path = line.substr(start);
+    return !path.empty();
+}
+
+UploadSpool::UploadSpool(const std::string &journalPath, upload_spool_config_t config)
+    : journalPath_(journalPath), config_(config), fd_(-1), records_(0), rng_(std::random_device()()) {
+}
+
+UploadSpool::~UploadSpool() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool UploadSpool::open() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    replay();
+    // Rewriting also cuts off a torn last record
+    return compactLocked();
+}
+
+bool UploadSpool::replay() {
+    entries_.clear();
+    std::ifstream file(journalPath_, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    size_t malformed = 0;
+    size_t start = 0;
+    size_t end;
+    std::vector<std::string> fields;
+    std::string path;
+    // A line without its newline was cut short by a crash and is ignored
+    while ((end = contents.find('\n', start)) != std::string::npos) {
+        std::string line = contents.substr(start, end - start);
+        start = end + 1;
+        if (line.size() < 3 || line[1] != '\t') {
+            malformed++;
+            continue;
+        }
+        char *parse_end = nullptr;
+        if (line[0] == 'P' && splitRecord(line, 6, fields, path)) {
+            spool_entry_t entry;
+            entry.path = path;
+            entry.size = std::strtoull(fields[0].c_str(), &parse_end, 10);
+            entry.mtime_ns = std::strtoll(fields[1].c_str(), &parse_end, 10);
+            entry.timestamp = static_cast<time_t>(std::strtoll(fields[2].c_str(), &parse_end, 10));
+            entry.attempts = static_cast<uint32_t>(std::strtoul(fields[3].c_str(), &parse_end, 10));
+            entry.next_attempt_ms = std::strtoll(fields[4].c_str(), &parse_end, 10);
+            entry.sensorId = fields[5];
+            entry.state = SPOOL_PENDING;
+            entry.in_flight = false;
+            entries_[path] = entry;
+        } else if (line[0] == 'D' && splitRecord(line, 2, fields, path)) {
+            spool_entry_t &entry = entries_[path];
+            entry.path = path;
+            entry.size = std::strtoull(fields[0].c_str(), &parse_end, 10);
+            entry.mtime_ns = std::strtoll(fields[1].c_str(), &parse_end, 10);
+            entry.state = SPOOL_DONE;
+            entry.attempts = 0;
+            entry.next_attempt_ms = 0;
+            entry.in_flight = false;
+        } else if (line[0] == 'X') {
+            entries_.erase(line.substr(2));
+        } else {
+            malformed++;
+        }
+    }
+    if (malformed > 0) {
+        log_err << journalPath_ << ": skipped " << malformed << " malformed records" << std::endl;
+    }
+    if (start < contents.size()) {
+        log_info << journalPath_ << ": ignoring torn last record" << std::endl;
+    }
+    return true;
+}
+
+bool UploadSpool::compact() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return compactLocked();
+}
+
+bool UploadSpool::compactLocked() {
+    std::string contents;
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (it->second.state == SPOOL_DONE) {
+            // Nothing left to deduplicate against once the file is gone
+            uint64_t size;
+            int64_t mtime_ns;
+            if (!fileVersion(it->first, size, mtime_ns)) {
+                it = entries_.erase(it);
+                continue;
+            }
+            contents += doneRecord(it->second);
+        } else {
+            contents += pendingRecord(it->second);
+        }
+        ++it;
+    }
+
+    std::string tmpname = journalPath_ + ".tmp";
+    int fd = ::open(tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        log_err << "Error opening " << tmpname << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (!writeAll(fd, contents.data(), contents.size()) || fsync(fd) != 0) {
+        log_err << "Error writing " << tmpname << ": " << strerror(errno) << std::endl;
+        close(fd);
+        unlink(tmpname.c_str());
+        return false;
+    }
+    close(fd);
+    if (rename(tmpname.c_str(), journalPath_.c_str()) != 0) {
+        log_err << "Error renaming " << tmpname << ": " << strerror(errno) << std::endl;
+        unlink(tmpname.c_str());
+        return false;
+    }
+    size_t slash = journalPath_.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : journalPath_.substr(0, slash));
+    int dirfd = ::open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+    if (dirfd >= 0) {
+        fsync(dirfd);
+        close(dirfd);
+    }
+
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+    fd_ = ::open(journalPath_.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (fd_ < 0) {
+        log_err << "Error opening " << journalPath_ << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    records_ = entries_.size();
+    return true;
+}
+
+bool UploadSpool::appendRecord(const std::string &record) {
+    if (fd_ < 0) {
+        return false;
+    }
+    if (!writeAll(fd_, record.data(), record.size())) {
+        log_err << "Error writing " << journalPath_ << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (config_.sync) {
+#ifdef __APPLE__
+        fsync(fd_);
+#else
+        fdatasync(fd_);
+#endif
+    }
+    records_++;
+    return true;
+}
+
+// Called once a public method is done iterating, compaction erases entries
+void UploadSpool::compactIfNeeded() {
+    if (records_ >= config_.compact_records && records_ > 2 * entries_.size()) {
+        compactLocked();
+    }
+}
+
+int64_t UploadSpool::backoffMs(uint32_t attempts) {
+    int64_t delay = config_.base_backoff_ms;
+    for (uint32_t i = 1; i < attempts && delay < config_.max_backoff_ms; i++) {
+        delay *= 2;
+    }
+    delay = std::min(delay, config_.max_backoff_ms);
+    // Equal jitter: half the delay fixed, half random, so retries after an outage spread out
+    std::uniform_int_distribution<int64_t> jitter(0, delay / 2);
+    return delay - delay / 2 + jitter(rng_);
+}
+
+bool UploadSpool::enqueue(const std::string &path, const std::string &sensorId, time_t timestamp) {
+    uint64_t size;
+    int64_t mtime_ns;
+    if (!fileVersion(path, size, mtime_ns)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(path);
+    if (it != entries_.end() && it->second.size == size && it->second.mtime_ns == mtime_ns) {
+        return false;
+    }
+    // New file, or a new version of one; an upload of the old version still running is left to finish
+    spool_entry_t &entry = entries_[path];
+    bool in_flight = it != entries_.end() && entry.in_flight;
+    entry.path = path;
+    entry.sensorId = sensorId;
+    entry.timestamp = timestamp;
+    entry.size = size;
+    entry.mtime_ns = mtime_ns;
+    entry.state = SPOOL_PENDING;
+    entry.attempts = 0;
+    entry.next_attempt_ms = 0;
+    entry.in_flight = in_flight;
+    appendRecord(pendingRecord(entry));
+    compactIfNeeded();
+    return true;
+}
+
+std::vector<spool_entry_t> UploadSpool::due(size_t max) {
+    std::vector<spool_entry_t> batch;
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t now = wallClockMs();
+    for (auto it = entries_.begin(); it != entries_.end() && batch.size() < max;) {
+        spool_entry_t &entry = it->second;
+        if (entry.state != SPOOL_PENDING || entry.in_flight || entry.next_attempt_ms > now) {
+            ++it;
+            continue;
+        }
+        uint64_t size;
+        int64_t mtime_ns;
+        if (!fileVersion(entry.path, size, mtime_ns)) {
+            log_info << entry.path << " disappeared before upload" << std::endl;
+            std::string path = entry.path;
+            it = entries_.erase(it);
+            appendRecord(forgetRecord(path));
+            continue;
+        }
+        if (size != entry.size || mtime_ns != entry.mtime_ns) {
+            entry.size = size;
+            entry.mtime_ns = mtime_ns;
+            entry.attempts = 0;
+            appendRecord(pendingRecord(entry));
+        }
+        entry.in_flight = true;
+        batch.push_back(entry);
+        ++it;
+    }
+    compactIfNeeded();
+    return batch;
+}
+
+void UploadSpool::markDone(const spool_entry_t &uploaded) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(uploaded.path);
+    if (it == entries_.end()) {
+        return;
+    }
+    spool_entry_t &entry = it->second;
+    entry.in_flight = false;
+    // The file changed while it was uploading, the new version stays pending
+    if (entry.state != SPOOL_PENDING || entry.size != uploaded.size || entry.mtime_ns != uploaded.mtime_ns) {
+        return;
+    }
+    entry.state = SPOOL_DONE;
+    entry.attempts = 0;
+    entry.next_attempt_ms = 0;
+    appendRecord(doneRecord(entry));
+    compactIfNeeded();
+}
+
+void UploadSpool::markFailed(const spool_entry_t &uploaded) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(uploaded.path);
+    if (it == entries_.end()) {
+        return;
+    }
+    spool_entry_t &entry = it->second;
+    entry.in_flight = false;
+    if (entry.state != SPOOL_PENDING || entry.size != uploaded.size || entry.mtime_ns != uploaded.mtime_ns) {
+        return;
+    }
+    entry.attempts++;
+    if (config_.max_attempts > 0 && entry.attempts >= config_.max_attempts) {
+        log_err << "giving up on " << entry.path << " after " << entry.attempts << " attempts" << std::endl;
+        std::string path = entry.path;
+        entries_.erase(it);
+        appendRecord(forgetRecord(path));
+        compactIfNeeded();
+        return;
+    }
+    entry.next_attempt_ms = wallClockMs() + backoffMs(entry.attempts);
+    appendRecord(pendingRecord(entry));
+    compactIfNeeded();
+}
+
+int64_t UploadSpool::nextDueMs() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t now = wallClockMs();
+    int64_t next = -1;
+    for (const auto &it : entries_) {
+        const spool_entry_t &entry = it.second;
+        if (entry.state != SPOOL_PENDING || entry.in_flight) {
+            continue;
+        }
+        int64_t wait = std::max<int64_t>(0, entry.next_attempt_ms - now);
+        if (next < 0 || wait < next) {
+            next = wait;
+        }
+    }
+    return next;
+}
+
+size_t UploadSpool::pending() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t count = 0;
+    for (const auto &it : entries_) {
+        if (it.second.state == SPOOL_PENDING) {
+            count++;
+        }
+    }
+    return count;
+}
+
+size_t UploadSpool::done() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t count = 0;
+    for (const auto &it : entries_) {
+        if (it.second.state == SPOOL_DONE) {
+            count++;
+        }
+    }
+    return count;
+}
+
+bool UploadSpool::find(const std::string &path, spool_entry_t &entry) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(path);
+    if (it == entries_.end()) {
+        return false;
+    }
+    entry = it->second;
+    return true;
+}
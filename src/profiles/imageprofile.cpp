@@ -5,10 +5,14 @@
 
 #include <vector>
 #include <cmath>
+#include <algorithm>
 #include "imageprofile.h"
 #include "iniparser.h"
+#include "datatracer_log.h"
 
 ImageProfile::~ImageProfile() {
+    delete pool;
+    delete sampleWriter;
     delete saver;
     for (const auto& obj :  meanBox)
         delete obj;
@@ -28,44 +32,58 @@ ImageProfile::~ImageProfile() {
 
 
 ImageProfile::ImageProfile(std::string conf_path, int save_interval, int channels=1) {
+    statsMask = 0;
+    saver = nullptr;
+    sampleWriter = nullptr;
+    pool = nullptr;
     try {
-        saver = new Saver(save_interval, "ImageProfile");
-
       // Read configuration settings
 		IniParser parser; // Assuming filename is correct
       imageConfig = parser.parseIniFile(conf_path,
 		      "image", "");
       filesSavePath = imageConfig["filepath"];
       createFolderIfNotExists(filesSavePath);
+      sample_writer_config_t writerConfig = parseSampleWriterConfig(imageConfig);
+      saver_config_t saverConfig = parseSaverConfig(imageConfig);
+      size_t batchThreads = 0;
+      auto it = imageConfig.find("batch_threads");
+      if (it != imageConfig.end()) {
+        try {
+          batchThreads = std::stoul(it->second);
+        } catch (const std::exception& e) {
+          log_err << "invalid batch_threads " << it->second << std::endl;
+        }
+        imageConfig.erase(it);
+      }
+
+      // Compile the metrics first so a bad threshold throws before any thread starts
+      compileMetricPlan(channels);
+
+      saver = new Saver(save_interval, "ImageProfile", saverConfig);
+      sampleWriter = new SampleWriter(writerConfig);
+      if (batchThreads > 1) {
+        pool = new ThreadPool(batchThreads);
+      }
       // Register statistics for saving based on configuration
-      for (const auto& stat_confidence : imageConfig) {
-        std::string name = stat_confidence.first;
-          if (strcmp(name.c_str(), "NOISE") == 0){
-            saver->AddObjectToSave((void*)(&noiseBox), KLL_TYPE, filesSavePath+"noise.bin");
-	  }  
-          else if (strcmp(name.c_str(), "BRIGHTNESS") == 0){
-            saver->AddObjectToSave((void*)(&brightnessBox), KLL_TYPE, filesSavePath+"brightness.bin");
-	  }  
-          else if (strcmp(name.c_str(), "SHARPNESS") == 0){
-            saver->AddObjectToSave((void*)(&sharpnessBox), KLL_TYPE, filesSavePath+"sharpness.bin");
-	  }
-          else if (strcmp(name.c_str(), "MEAN") == 0){
-		  for (int i = 0; i < channels; ++i) {
-		       distributionBox *dbox = new distributionBox(200);	  
-		       meanBox.push_back(dbox);
-                       saver->AddObjectToSave((void*)(dbox),
-				       KLL_TYPE, filesSavePath+"mean_"+std::to_string(i)+".bin"); 
-                   }
-	  } 
-          else if (strcmp(name.c_str(), "HISTOGRAM") == 0) {
-             for (int i = 0; i < channels; ++i) {
-		       distributionBox *dbox_hist = new distributionBox(200);	
-                       pixelBox.push_back(dbox_hist);
-		       saver->AddObjectToSave((void*)(dbox_hist),
-				       KLL_TYPE, filesSavePath+"pixel_"+std::to_string(i)+".bin"); 
-             }
-          }	     
-       }
+      for (const auto& metric : metricPlan) {
+        switch (metric.id) {
+          case IMAGE_METRIC_MEAN:
+            for (size_t i = 0; i < meanBox.size(); ++i) {
+              saver->AddObjectToSave(meanBox[i], filesSavePath+"mean_"+std::to_string(i)+".bin");
+            }
+            break;
+          case IMAGE_METRIC_HISTOGRAM:
+            for (size_t i = 0; i < pixelBox.size(); ++i) {
+              saver->AddObjectToSave(pixelBox[i], filesSavePath+"pixel_"+std::to_string(i)+".bin");
+            }
+            break;
+          case IMAGE_METRIC_CONTRAST:
+            break;
+          default:
+            saver->AddObjectToSave(metric.box, filesSavePath+metric.file);
+            break;
+        }
+      }
     saver->StartSaving();
 #ifndef TEST
     /*int uploadtype=1;
@@ -82,65 +100,200 @@ ImageProfile::ImageProfile(std::string conf_path, int save_interval, int channel
     }
   }
 
+static double sharpnessScore(const image_stats_t &stats) {
+    return stats.laplacianVariance;
+}
+
+  /**
+   * @brief Turns the [image] section into the flat metric list used by profile()
+   * @param channels Number of per-channel sketches for MEAN and HISTOGRAM
+   * @throws std::invalid_argument if a metric threshold is not a number
+   */
+void ImageProfile::compileMetricPlan(int channels) {
+    metricPlan.clear();
+    for (const auto& stat_confidence : imageConfig) {
+        const std::string& name = stat_confidence.first;
+        image_metric_t metric = {IMAGE_METRIC_MAX, name, "", 0.0f, nullptr, nullptr};
+        if (name == "NOISE") {
+            metric.id = IMAGE_METRIC_NOISE;
+            metric.box = &noiseBox;
+            metric.file = "noise.bin";
+            metric.score = statsSNR;
+            statsMask |= STATS_MEAN_STDDEV;
+        } else if (name == "BRIGHTNESS") {
+            metric.id = IMAGE_METRIC_BRIGHTNESS;
+            metric.box = &brightnessBox;
+            metric.file = "brightness.bin";
+            metric.score = statsBrightness;
+            statsMask |= STATS_CHANNEL_MEANS;
+        } else if (name == "SHARPNESS") {
+            metric.id = IMAGE_METRIC_SHARPNESS;
+            metric.box = &sharpnessBox;
+            metric.file = "sharpness.bin";
+            metric.score = sharpnessScore;
+            statsMask |= STATS_LAPLACIAN;
+        } else if (name == "CONTRAST") {
+            metric.id = IMAGE_METRIC_CONTRAST;
+            metric.box = &contrastBox;
+            metric.score = statsContrast;
+            statsMask |= STATS_MIN_MAX;
+        } else if (name == "MEAN") {
+            metric.id = IMAGE_METRIC_MEAN;
+            statsMask |= STATS_CHANNEL_MEANS;
+        } else if (name == "HISTOGRAM") {
+            metric.id = IMAGE_METRIC_HISTOGRAM;
+        } else {
+            continue;
+        }
+        if (metric.score != nullptr) {
+            metric.threshold = IniParser::parseThreshold(name, stat_confidence.second);
+        }
+        metricPlan.push_back(metric);
+    }
+
+    for (const auto& metric : metricPlan) {
+        if (metric.id == IMAGE_METRIC_MEAN) {
+            for (int i = 0; i < channels; ++i) {
+                meanBox.push_back(new shardedDistributionBox(distributionBox(200)));
+            }
+        } else if (metric.id == IMAGE_METRIC_HISTOGRAM) {
+            for (int i = 0; i < channels; ++i) {
+                pixelBox.push_back(new shardedDistributionBox(distributionBox(200)));
+            }
+        }
+    }
+}
+
 
   /**
    * @brief Computes and logs selected image statistics
-   * @param imgprofile Vector of statistics to compute
    * @param img OpenCV image matrix
    * @param save_sample Flag indicating whether to save samples exceeding thresholds
    * @return 1 on success, error code on failure
    */
   int ImageProfile::profile(cv::Mat &img, bool save_sample = false) {
-    float stat_score;
-    for (const auto& imgstat : imageConfig) {
-		// Access name and threshold from the pair
-		std::string name = imgstat.first;
-		std::string baseName = name;
-	if (strcmp(name.c_str(), "NOISE") == 0) {
-          // Compute noise statistic
-          stat_score = calculateSNR(img);
-	  float threshold = std::stof(imgstat.second);
-          // Update corresponding distribution box and save image if threshold exceeded
-          noiseBox.update(stat_score);
-          if (stat_score >= threshold && save_sample == true) {
-			  std::string imagePath = filesSavePath;
-              std::string savedImagePath = saveImageWithIncrementalName(img, imagePath, baseName);
+    // Grayscale conversion and image scans are shared by all configured metrics
+    image_stats_t stats = computeImageStats(img, statsMask);
+    // Metrics that selected this frame; it is written once for all of them
+    std::vector<sample_reason_t> reasons;
+    for (const auto& metric : metricPlan) {
+        switch (metric.id) {
+          case IMAGE_METRIC_MEAN: {
+            size_t channels = std::min(meanBox.size(), static_cast<size_t>(img.channels()));
+            for (size_t i = 0; i < channels; ++i) {
+                meanBox[i]->update(stats.channelMeans[i]);
+            }
+            break;
           }
-        } else if (strcmp(name.c_str(), "BRIGHTNESS") == 0) {
-			stat_score = calculateBrightness(img);
-		        float threshold = std::stof(imgstat.second);
-			brightnessBox.update(stat_score);
-			std::cout << "updated brightness box" <<std::endl;
-			if (stat_score >= threshold && save_sample==true){
-				std::string imagePath = filesSavePath;
-                std::string savedImagePath = saveImageWithIncrementalName(img, imagePath, baseName);
+          case IMAGE_METRIC_HISTOGRAM: {
+            // Scratch buffers are per thread since profile() may run on several threads
+            static thread_local std::vector<channelHistogram> pixelHistograms;
+            calculateChannelHistograms(img, pixelHistograms);
+            updatePixelHistograms(pixelHistograms);
+            break;
+          }
+          default: {
+            float stat_score = metric.score(stats);
+            // Update corresponding distribution box and save image if threshold exceeded
+            metric.box->update(stat_score);
+            if (save_sample && stat_score >= metric.threshold) {
+                reasons.push_back({metric.name, stat_score, metric.threshold});
+            }
+            break;
           }
-        } else if (strcmp(name.c_str(), "SHARPNESS") == 0) {
-			stat_score = calculateSharpnessLaplacian(img);
-		        float threshold = std::stof(imgstat.second);
-			sharpnessBox.update(stat_score);
-			if (stat_score >= threshold && save_sample==true){
-			    std::string imagePath = filesSavePath;
-			    std::string savedImagePath = saveImageWithIncrementalName(img, imagePath, baseName);
-			}
-        } else if (strcmp(name.c_str(), "MEAN") == 0) {
-		         cv::Scalar mean_values = cv::mean(img);
-			 for (int i = 0; i < img.channels(); ++i) {
-			      meanBox[i]->update(mean_values[i]);	 
-                         }    
-        } else if (strcmp(name.c_str(), "CONTRAST") == 0) {
-			stat_score = calculateContrast(img);
-		        float threshold = std::stof(imgstat.second);
-			contrastBox.update(stat_score);
-			if (stat_score >= threshold && save_sample==true){
-			    std::string imagePath = filesSavePath;
-			    std::string savedImagePath = saveImageWithIncrementalName(img, imagePath, baseName);
-			}
-        } else if (strcmp(name.c_str(), "HISTOGRAM") == 0) {
-		std::function<void(const std::vector<int>&)> callback = [this](const std::vector<int>& pixelValues) {
-            this->updatePixelValues(pixelValues); // Use the class's method as the callback
-	    };
-	    iterateImage(img, callback);
+        }
+    }
+    if (!reasons.empty()) {
+        sampleWriter->enqueue(img, filesSavePath, reasons);
+    }
+    return 1; // Indicate success
+  }
+
+  /**
+   * @brief Computes and logs selected image statistics for a batch of images
+   * @param imgs Images of the batch
+   * @param save_sample Flag indicating whether to save samples exceeding thresholds
+   * @return 1 on success, error code on failure
+   */
+  int ImageProfile::profileBatch(const std::vector<cv::Mat> &imgs, bool save_sample) {
+    const size_t count = imgs.size();
+    if (count == 0) {
+        return 1;
+    }
+    // Scratch buffers are per thread since profileBatch() may run on several threads
+    static thread_local std::vector<image_stats_t> batchStats;
+    static thread_local std::vector<std::vector<channelHistogram>> batchHistograms;
+    static thread_local std::vector<std::vector<sample_reason_t>> batchReasons;
+    static thread_local std::vector<float> batchScores;
+    static thread_local std::vector<channelHistogram> pixelHistograms;
+    const bool needHistograms = !pixelBox.empty();
+    batchStats.resize(count);
+    batchHistograms.resize(needHistograms ? count : 0);
+    batchReasons.resize(count);
+    for (auto& reasons : batchReasons) {
+        reasons.clear();
+    }
+
+    // Per-image scans are independent, so they are the part fanned out to the pool.
+    // The caller's scratch buffers are captured by address: naming a thread_local
+    // inside the lambda would resolve to the worker's own copy.
+    auto scanImage = [this, &imgs, needHistograms, stats = &batchStats, histograms = &batchHistograms](size_t i) {
+        (*stats)[i] = computeImageStats(imgs[i], statsMask);
+        if (needHistograms) {
+            calculateChannelHistograms(imgs[i], (*histograms)[i]);
+        }
+    };
+    if (pool != nullptr && count > 1) {
+        pool->parallelFor(count, scanImage);
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            scanImage(i);
+        }
+    }
+
+    // Sketches are updated on the calling thread, once per metric for the whole batch
+    for (const auto& metric : metricPlan) {
+        switch (metric.id) {
+          case IMAGE_METRIC_MEAN:
+            for (size_t c = 0; c < meanBox.size(); ++c) {
+                batchScores.clear();
+                for (size_t i = 0; i < count; ++i) {
+                    if (static_cast<size_t>(imgs[i].channels()) > c) {
+                        batchScores.push_back(static_cast<float>(batchStats[i].channelMeans[c]));
+                    }
+                }
+                meanBox[c]->update(batchScores.data(), batchScores.size());
+            }
+            break;
+          case IMAGE_METRIC_HISTOGRAM:
+            pixelHistograms.assign(pixelBox.size(), channelHistogram{});
+            for (const auto& histograms : batchHistograms) {
+                size_t channels = std::min(histograms.size(), pixelHistograms.size());
+                for (size_t c = 0; c < channels; ++c) {
+                    for (int value = 0; value < 256; ++value) {
+                        pixelHistograms[c][value] += histograms[c][value];
+                    }
+                }
+            }
+            updatePixelHistograms(pixelHistograms);
+            break;
+          default:
+            batchScores.resize(count);
+            for (size_t i = 0; i < count; ++i) {
+                float stat_score = metric.score(batchStats[i]);
+                batchScores[i] = stat_score;
+                if (save_sample && stat_score >= metric.threshold) {
+                    batchReasons[i].push_back({metric.name, stat_score, metric.threshold});
+                }
+            }
+            metric.box->update(batchScores.data(), batchScores.size());
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (!batchReasons[i].empty()) {
+            sampleWriter->enqueue(imgs[i], filesSavePath, batchReasons[i]);
         }
     }
     return 1; // Indicate success
@@ -179,3 +332,14 @@ void ImageProfile::updatePixelValues(const std::vector<int>& pixelValues) {
             pixelBox[i]->update(pixelValues[i]);
     }
 }
+
+void ImageProfile::updatePixelHistograms(const std::vector<channelHistogram>& histograms) {
+    size_t channels = std::min(histograms.size(), pixelBox.size());
+    for (size_t i = 0; i < channels; ++i) {
+        for (int value = 0; value < 256; ++value) {
+            if (histograms[i][value] != 0) {
+                pixelBox[i]->update(static_cast<float>(value), histograms[i][value]);
+            }
+        }
+    }
+}
@@ -26,15 +26,15 @@ ModelProfile::ModelProfile(std::string model_id, std::string conf_path,
     std::string token="";
 
   // Set member variables
-  saver = new Saver(save_interval, "ModelProfile");
   model_id_ = model_id;
   IniParser parser;
   modelConfig = parser.parseIniFile(conf_path,
                           "model", "");
+  saver = new Saver(save_interval, "ModelProfile", parseSaverConfig(modelConfig));
   filesSavePath = modelConfig["filepath"];
   createFolderIfNotExists(filesSavePath);
   top_classes_ = top_classes;
-  sketch1 = new frequent_class_sketch(64);
+  sketch1 = new ShardedSketch<frequent_class_sketch>(frequent_class_sketch(64));
   saver->StartSaving();
 #ifndef TEST
     /*int uploadtype=0;
@@ -66,19 +66,62 @@ int ModelProfile::log_classification_model_stats(float inference_latency __attri
     for (const auto& result : results) {
         int cls = result.second;
         float score = result.first;
+        classBox(cls)->update(score);
+        sketch1->update(std::to_string(cls));  // Placeholder for storing frequent class IDs
+    }
+  return 0; // Assuming successful logging, replace with error handling if needed
+}
+
+/**
+ * @brief Logs classification model statistics for a batch of images
+ * @param inference_latency Time taken for inference of the whole batch
+ * @param batch Classification results, one entry per image
+ * @return 0 on success, negative value on error
+ */
+int ModelProfile::log_classification_model_stats_batch(float inference_latency __attribute__((unused)),
+	       	const std::vector<ClassificationResults>& batch) {
+    // Scratch per-class scores, per thread and reused across batches
+    static thread_local std::map<int, std::vector<float>> batch_scores;
+    for (auto& pair : batch_scores) {
+        pair.second.clear();
+    }
+    for (const auto& results : batch) {
+        for (const auto& result : results) {
+            batch_scores[result.second].push_back(result.first);
+        }
+    }
+    for (const auto& pair : batch_scores) {
+        const std::vector<float>& scores = pair.second;
+        if (scores.empty()) {
+            continue;
+        }
+        classBox(pair.first)->update(scores.data(), scores.size());
+        sketch1->update(std::to_string(pair.first), scores.size());
+    }
+  return 0;
+}
+
+/**
+ * @brief Returns the score sketch of a class, creating and registering it on first use
+ * @param cls Class ID
+ * @return The class sketch
+ */
+shardedDistributionBox *ModelProfile::classBox(int cls) {
+    {
+        std::shared_lock<std::shared_timed_mutex> lock(classes_mutex_);
         auto it = model_classes_stat_.find(cls);
         if (it != model_classes_stat_.end()) {
-            // Key exists, update the value
-            it->second->update(score);
-        } else {
-            // Key does not exist, add the key-value pair
-            dBox = new distributionBox(200);
-            model_classes_stat_[cls] = dBox;
-            model_classes_stat_[cls]->update(score);
-            saver->AddObjectToSave((void *)(dBox), KLL_TYPE,
-                                   filesSavePath + model_id_ + std::to_string(cls) + ".bin");  // Register with Saver for saving
+            return it->second;
         }
-        sketch1->update(std::to_string(cls));  // Placeholder for storing frequent class IDs
     }
-  return 0; // Assuming successful logging, replace with error handling if needed
+    std::unique_lock<std::shared_timed_mutex> lock(classes_mutex_);
+    // Another thread may have added the class between the two locks
+    auto it = model_classes_stat_.find(cls);
+    if (it != model_classes_stat_.end()) {
+        return it->second;
+    }
+    shardedDistributionBox *box = new shardedDistributionBox(distributionBox(200));
+    model_classes_stat_[cls] = box;
+    saver->AddObjectToSave(box, filesSavePath + model_id_ + std::to_string(cls) + ".bin");  // Register with Saver for saving
+    return box;
 }
@@ -73,6 +73,54 @@ TEST_F(ImageProfileTest, ProfileMethod) {
     EXPECT_TRUE(infile3.is_open());  // The file should exist
 }
 
+// Test profileBatch updates each sketch once per image of the batch
+TEST_F(ImageProfileTest, ProfileBatch) {
+    std::vector<cv::Mat> imgs = {
+        cv::Mat::ones(100, 100, CV_8UC1) * 64,
+        cv::Mat::ones(100, 100, CV_8UC1) * 128,
+        cv::Mat::ones(50, 80, CV_8UC1) * 192,
+    };
+    EXPECT_EQ(image_profile->profileBatch(imgs, false), 1);
+    EXPECT_EQ(image_profile->noiseBox.snapshot().get_n(), 3u);
+    EXPECT_EQ(image_profile->sharpnessBox.snapshot().get_n(), 3u);
+    distributionBox mean = image_profile->meanBox[0]->snapshot();
+    EXPECT_EQ(mean.get_n(), 3u);
+    EXPECT_FLOAT_EQ(mean.get_min_item(), 64.0f);
+    EXPECT_FLOAT_EQ(mean.get_max_item(), 192.0f);
+    EXPECT_EQ(image_profile->meanBox[1]->snapshot().get_n(), 0u);
+}
+
+// Test several threads can profile through the same instance
+TEST_F(ImageProfileTest, ConcurrentProfile) {
+    const int threads = 4;
+    const int frames = 25;
+    std::vector<std::thread> producers;
+    for (int t = 0; t < threads; ++t) {
+        producers.emplace_back([this, t] {
+            cv::Mat img = cv::Mat::ones(32, 32, CV_8UC1) * (t * 50);
+            for (int i = 0; i < frames; ++i) {
+                image_profile->profile(img, false);
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    EXPECT_EQ(image_profile->noiseBox.snapshot().get_n(), static_cast<uint64_t>(threads * frames));
+    EXPECT_EQ(image_profile->meanBox[0]->snapshot().get_n(), static_cast<uint64_t>(threads * frames));
+}
+
+// Test an invalid threshold is rejected when the profile is constructed
+TEST_F(ImageProfileTest, InvalidThresholdThrows) {
+    std::ofstream ini_file("bad_config.ini", std::ios::trunc);
+    ini_file << "[image]\n";
+    ini_file << "filepath = ./\n";
+    ini_file << "NOISE = 0.5x\n";
+    ini_file.close();
+    EXPECT_THROW(ImageProfile("bad_config.ini", 1, 1), std::invalid_argument);
+    std::remove("bad_config.ini");
+}
+
 // Test the handling of empty images in iterateImage method
 TEST_F(ImageProfileTest, IterateImageInvalidImage) {
     cv::Mat empty_img;  // Create an empty image to trigger exception
@@ -85,8 +133,8 @@ TEST_F(ImageProfileTest, IterateImageInvalidImage) {
 
 //Test the StartSaving and TriggerSave methods for threading behavior
 TEST_F(ImageProfileTest, ThreadingBehavior) {
-    // Check if the save thread is still running
-    EXPECT_TRUE(image_profile->saver->save_thread_.joinable());
+    // Check if the saver is still registered with the save scheduler
+    EXPECT_TRUE(image_profile->saver->IsSaving());
     // Further checks can include more detailed validation of queue processing
 }
 
@@ -90,3 +90,39 @@ TEST_F(ModelProfileTest, ObjectsRegisteredWithSaver) {
     EXPECT_EQ(model_profile->saver->objects_to_save_.size(), 3); // Should have 3 objects to save
 }
 
+
+// Test batched logging groups scores by class
+TEST_F(ModelProfileTest, LogClassificationModelStatsBatch) {
+    std::vector<ClassificationResults> batch = {
+        {{0.9f, 1}, {0.1f, 2}},
+        {{0.7f, 1}, {0.3f, 2}},
+        {{0.6f, 1}},
+    };
+    int result = model_profile->log_classification_model_stats_batch(2.5f, batch);
+    EXPECT_EQ(result, 0);
+    EXPECT_EQ(model_profile->saver->objects_to_save_.size(), 2);
+    EXPECT_EQ(model_profile->model_classes_stat_[1]->snapshot().get_n(), 3u);
+    EXPECT_EQ(model_profile->model_classes_stat_[2]->snapshot().get_n(), 2u);
+    EXPECT_EQ(model_profile->sketch1->snapshot().get_estimate("1"), 3u);
+}
+
+// Test concurrent logging from several threads registers each class once
+TEST_F(ModelProfileTest, ConcurrentLogging) {
+    const int threads = 4;
+    const int calls = 200;
+    std::vector<std::thread> producers;
+    for (int t = 0; t < threads; ++t) {
+        producers.emplace_back([this] {
+            ClassificationResults results = {{0.9f, 7}, {0.1f, 8}};
+            for (int i = 0; i < calls; ++i) {
+                model_profile->log_classification_model_stats(1.0f, results);
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    EXPECT_EQ(model_profile->saver->objects_to_save_.size(), 2);
+    EXPECT_EQ(model_profile->model_classes_stat_[7]->snapshot().get_n(), static_cast<uint64_t>(threads * calls));
+    EXPECT_EQ(model_profile->sketch1->snapshot().get_estimate("8"), static_cast<uint64_t>(threads * calls));
+}
@@ -4,8 +4,10 @@
  */
 #include "imagesampler.h"
 #include "imghelpers.h"
+#include "datatracer_log.h"
 
 ImageSampler::~ImageSampler() {
+    delete sampleWriter;
     delete saver;
 }
 
@@ -19,27 +21,26 @@ ImageSampler::~ImageSampler() {
    * @param saver Saver object for saving sampling statistics
    */
 ImageSampler::ImageSampler(std::string conf_path, int save_interval) {
+  needEntropy = false;
+  saver = nullptr;
+  sampleWriter = nullptr;
   try {
-    saver = new Saver(save_interval, "ImageSampler");
-
     // Read configuration settings
     IniParser parser; // Assuming filename is correct
     samplingConfig = parser.parseIniFile(conf_path, "sampling", "");
     filesSavePath = samplingConfig["filepath"];
     samplingConfig.erase("filepath");
+    sample_writer_config_t writerConfig = parseSampleWriterConfig(samplingConfig);
+    saver_config_t saverConfig = parseSaverConfig(samplingConfig);
+
+    // Compile the metrics first so a bad threshold throws before any thread starts
+    compileMetricPlan();
+
+    saver = new Saver(save_interval, "ImageSampler", saverConfig);
+    sampleWriter = new SampleWriter(writerConfig);
     // Register sampling statistics for saving based on configuration
-    for (const auto& sampling_confidence : samplingConfig) {
-      std::string name = sampling_confidence.first;
-      if (strcmp(name.c_str(), "MARGINCONFIDENCE") == 0) {
-      saver->AddObjectToSave((void*)(&marginConfidenceBox), KLL_TYPE, filesSavePath+"marginconfidence.bin");
-      } else if(strcmp(name.c_str(), "LEASTCONFIDENCE") == 0) {
-      saver->AddObjectToSave((void*)(&leastConfidenceBox), KLL_TYPE, filesSavePath+"leastconfidence.bin");
-      } else if(strcmp(name.c_str(), "RATIOCONFIDENCE") == 0) {
-      // ... Register other sampling statistics similarly
-      saver->AddObjectToSave((void*)(&ratioConfidenceBox), KLL_TYPE, filesSavePath+"ratioconfidence.bin");
-      } else if(strcmp(name.c_str(), "ENTROPYCONFIDENCE") == 0) {
-      saver->AddObjectToSave((void*)(&entropyConfidenceBox), KLL_TYPE, filesSavePath+"entropyconfidence.bin");
-      }
+    for (const auto& metric : metricPlan) {
+      saver->AddObjectToSave(metric.box, filesSavePath+metric.file);
     }
     /*std::string endpointUrl="";
     std::string token="";
@@ -56,71 +57,303 @@ ImageSampler::ImageSampler(std::string conf_path, int save_interval) {
   }
 }
 
+  /**
+   * @brief Turns the [sampling] section into the flat metric list used by sample()
+   * @throws std::invalid_argument if a metric threshold is not a number
+   */
+void ImageSampler::compileMetricPlan() {
+  metricPlan.clear();
+  needEntropy = false;
+  for (const auto& sampling_confidence : samplingConfig) {
+    const std::string& name = sampling_confidence.first;
+    sampling_metric_t metric = {SAMPLING_METRIC_MAX, name, "", 0.0f, nullptr, nullptr};
+    if (name == "MARGINCONFIDENCE") {
+      metric.id = SAMPLING_METRIC_MARGIN;
+      metric.box = &marginConfidenceBox;
+      metric.file = "marginconfidence.bin";
+      metric.score = marginFromStats;
+    } else if (name == "LEASTCONFIDENCE") {
+      metric.id = SAMPLING_METRIC_LEAST;
+      metric.box = &leastConfidenceBox;
+      metric.file = "leastconfidence.bin";
+      metric.score = leastFromStats;
+    } else if (name == "RATIOCONFIDENCE") {
+      metric.id = SAMPLING_METRIC_RATIO;
+      metric.box = &ratioConfidenceBox;
+      metric.file = "ratioconfidence.bin";
+      metric.score = ratioFromStats;
+    } else if (name == "ENTROPYCONFIDENCE") {
+      metric.id = SAMPLING_METRIC_ENTROPY;
+      metric.box = &entropyConfidenceBox;
+      metric.file = "entropyconfidence.bin";
+      metric.score = entropyFromStats;
+      needEntropy = true;
+    } else {
+      continue;
+    }
+    metric.threshold = IniParser::parseThreshold(name, sampling_confidence.second);
+    metricPlan.push_back(metric);
+  }
+}
+
   /**
    * @brief Selects uncertain image samples based on configured criteria
    * @param results Vector of confidence scores for each image prediction
-   * @param uncertainty_sampling Vector indicating uncertainty criteria for each sample
    * @param img OpenCV image matrix
    * @param save_sample Flag indicating whether to save sampled images
    * @return 1 on success, error code on failure
    */
 
 int ImageSampler::sample(std::vector<std::pair<float, int>> &results, cv::Mat &img, bool save_sample = true) {
-	std::vector<float> confidence; // Extract confidence scores
-
-	// Extract confidence scores from results
+	// Extract confidence scores from results; scratch is per thread since sample() may run on several threads
+	static thread_local std::vector<float> confidence;
+	confidence.clear();
 	for (const auto& pair : results) {
 		confidence.push_back(pair.first);
 	}
-	float thresh = 0;
+	// One pass over the scores serves every configured metric
+	confidence_stats_t stats = computeConfidenceStats(confidence.data(), confidence.size(), needEntropy);
+	return sampleStats(stats, img, save_sample);
+}
+
+int ImageSampler::sample(const float *output, size_t size, cv::Mat &img, bool apply_softmax, bool save_sample) {
+	confidence_stats_t stats = computeTensorConfidenceStats(output, size, 1.0f, 0, apply_softmax, needEntropy);
+	return sampleStats(stats, img, save_sample);
+}
+
+int ImageSampler::sample(const uint8_t *output, size_t size, float scale, int zero_point,
+		cv::Mat &img, bool apply_softmax, bool save_sample) {
+	confidence_stats_t stats = computeTensorConfidenceStats(output, size, scale, zero_point, apply_softmax, needEntropy);
+	return sampleStats(stats, img, save_sample);
+}
+
+int ImageSampler::sampleStats(const confidence_stats_t &stats, cv::Mat &img, bool save_sample) {
+	// Metrics that selected this frame; it is written once for all of them
+	std::vector<sample_reason_t> reasons;
 	// Apply configured sampling criteria to identify uncertain samples
-	for (const auto& sampling_confidence : samplingConfig) {
-		std::string name = sampling_confidence.first;
-		std::string baseName = name;
-		try {
-        		thresh = std::stof(sampling_confidence.second);  // Attempt to convert the string to float
-        		std::cout << "Converted value: " << thresh << std::endl;
-    		} catch (const std::invalid_argument& e) {
-        		std::cerr << "Error: Invalid argument - " << e.what() << std::endl;
-   		} catch (const std::out_of_range& e) {
-        		std::cerr << "Error: Out of range - " << e.what() << std::endl;
-    		}
-		float confidence_score = -1.0f;
-
-		if (strcmp(name.c_str(), "MARGINCONFIDENCE") == 0) {
-			// Compute margin confidence and update statistics
-			confidence_score = margin_confidence(confidence, false);
-			marginConfidenceBox.update(confidence_score);
-			if (confidence_score >= thresh) {
-				std::string savedImagePath = saveImageWithIncrementalName(img, filesSavePath, baseName);
-			}
-		} else if (strcmp(name.c_str(), "LEASTCONFIDENCE") == 0) {
-			confidence_score = least_confidence(confidence, false);
-			leastConfidenceBox.update(confidence_score);
-			if (confidence_score >= thresh){
-				std::string savedImagePath = saveImageWithIncrementalName(img, filesSavePath, baseName);
-			}
-		} else if (strcmp(name.c_str(), "RATIOCONFIDENCE") == 0) {
-			confidence_score = ratio_confidence(confidence, false);
-			ratioConfidenceBox.update(confidence_score);
-			if (confidence_score >= thresh){
-				std::string imagePath = filesSavePath;
-				std::string savedImagePath = saveImageWithIncrementalName(img, filesSavePath, baseName);
-			}
-		} else if (strcmp(name.c_str(), "ENTROPYCONFIDENCE") == 0) {
-			confidence_score = entropy_confidence(confidence);
-			entropyConfidenceBox.update(confidence_score);
-			if (confidence_score >= thresh){
-				std::string imagePath = filesSavePath;
-				std::string savedImagePath = saveImageWithIncrementalName(img, filesSavePath, baseName);
+	for (const auto& metric : metricPlan) {
+		float confidence_score = metric.score(stats);
+		metric.box->update(confidence_score);
+		if (confidence_score >= metric.threshold) {
+			reasons.push_back({metric.name, confidence_score, metric.threshold});
+		}
+	}
+	if (!reasons.empty()) {
+		sampleWriter->enqueue(img, filesSavePath, reasons);
+	}
+	if (save_sample == false)
+		saver->StopSaving();
+	return 1; // Indicate success
+}
+
+
+  /**
+   * @brief Selects uncertain image samples from a batch of classification results
+   * @param results Confidence scores, one vector per image
+   * @param imgs Images of the batch
+   * @param save_sample Flag indicating whether to save sampled images
+   * @return 1 on success, -1 if results and imgs differ in size
+   */
+int ImageSampler::sampleBatch(std::vector<std::vector<std::pair<float, int>>> &results,
+		std::vector<cv::Mat> &imgs, bool save_sample) {
+	if (results.size() != imgs.size()) {
+		log_err << "sampleBatch: " << results.size() << " results for " << imgs.size() << " images" << std::endl;
+		return -1;
+	}
+	static thread_local std::vector<float> confidence;
+	static thread_local std::vector<confidence_stats_t> batchStats;
+	batchStats.resize(results.size());
+	for (size_t i = 0; i < results.size(); i++) {
+		confidence.clear();
+		for (const auto& pair : results[i]) {
+			confidence.push_back(pair.first);
+		}
+		batchStats[i] = computeConfidenceStats(confidence.data(), confidence.size(), needEntropy);
+	}
+	return sampleBatchStats(batchStats, imgs, save_sample);
+}
+
+int ImageSampler::sampleBatch(const float *output, size_t size, std::vector<cv::Mat> &imgs,
+		bool apply_softmax, bool save_sample) {
+	static thread_local std::vector<confidence_stats_t> batchStats;
+	batchStats.resize(imgs.size());
+	for (size_t i = 0; i < imgs.size(); i++) {
+		batchStats[i] = computeTensorConfidenceStats(output + i * size, size, 1.0f, 0, apply_softmax, needEntropy);
+	}
+	return sampleBatchStats(batchStats, imgs, save_sample);
+}
+
+int ImageSampler::sampleBatch(const uint8_t *output, size_t size, float scale, int zero_point,
+		std::vector<cv::Mat> &imgs, bool apply_softmax, bool save_sample) {
+	static thread_local std::vector<confidence_stats_t> batchStats;
+	batchStats.resize(imgs.size());
+	for (size_t i = 0; i < imgs.size(); i++) {
+		batchStats[i] = computeTensorConfidenceStats(output + i * size, size, scale, zero_point,
+				apply_softmax, needEntropy);
+	}
+	return sampleBatchStats(batchStats, imgs, save_sample);
+}
+
+int ImageSampler::sampleBatchStats(const std::vector<confidence_stats_t> &batchStats,
+		std::vector<cv::Mat> &imgs, bool save_sample) {
+	static thread_local std::vector<float> confidence;
+	static thread_local std::vector<std::vector<sample_reason_t>> batchReasons;
+	const size_t count = batchStats.size();
+	batchReasons.resize(count);
+	for (auto& reasons : batchReasons) {
+		reasons.clear();
+	}
+	// Score the whole batch per metric so each sketch gets a single update
+	confidence.resize(count);
+	for (const auto& metric : metricPlan) {
+		for (size_t i = 0; i < count; i++) {
+			float confidence_score = metric.score(batchStats[i]);
+			confidence[i] = confidence_score;
+			if (confidence_score >= metric.threshold) {
+				batchReasons[i].push_back({metric.name, confidence_score, metric.threshold});
 			}
 		}
+		metric.box->update(confidence.data(), count);
+	}
+	for (size_t i = 0; i < count; i++) {
+		if (!batchReasons[i].empty()) {
+			sampleWriter->enqueue(imgs[i], filesSavePath, batchReasons[i]);
+		}
 	}
 	if (save_sample == false)
 		saver->StopSaving();
 	return 1; // Indicate success
 }
 
+/**
+ * @brief Computes the top-1/top-2 probabilities and entropy in one pass
+ * @param prob_dist Class probabilities, in any order
+ * @param size Number of classes
+ * @param with_entropy Whether to accumulate the entropy sum
+ * @return The confidence statistics
+ */
+confidence_stats_t computeConfidenceStats(const float *prob_dist, size_t size, bool with_entropy) {
+    confidence_stats_t stats = {0.0f, 0.0f, 0.0f, size};
+    float top1 = -std::numeric_limits<float>::infinity();
+    float top2 = -std::numeric_limits<float>::infinity();
+    double raw_entropy = 0.0;
+    for (size_t i = 0; i < size; i++) {
+        const float p = prob_dist[i];
+        if (p > top1) {
+            top2 = top1;
+            top1 = p;
+        } else if (p > top2) {
+            top2 = p;
+        }
+        if (with_entropy && p > 0.0f) {
+            raw_entropy -= p * std::log2(p); // Multiply each probability by its base 2 log and sum
+        }
+    }
+    if (size > 0) {
+        stats.top1 = top1;
+    }
+    if (size > 1) {
+        stats.top2 = top2;
+    }
+    stats.entropy = static_cast<float>(raw_entropy);
+    return stats;
+}
+
+template<typename T>
+confidence_stats_t computeTensorConfidenceStats(const T *output, size_t size, float scale, int zero_point,
+                                                bool apply_softmax, bool with_entropy) {
+    if (!apply_softmax) {
+        if constexpr (std::is_same_v<T, float>) {
+            return computeConfidenceStats(output, size, with_entropy);
+        } else {
+            // Dequantize on the fly: p = scale * (q - zero_point)
+            confidence_stats_t stats = {0.0f, 0.0f, 0.0f, size};
+            float top1 = -std::numeric_limits<float>::infinity();
+            float top2 = -std::numeric_limits<float>::infinity();
+            double raw_entropy = 0.0;
+            for (size_t i = 0; i < size; i++) {
+                const float p = scale * (static_cast<float>(output[i]) - zero_point);
+                if (p > top1) {
+                    top2 = top1;
+                    top1 = p;
+                } else if (p > top2) {
+                    top2 = p;
+                }
+                if (with_entropy && p > 0.0f) {
+                    raw_entropy -= p * std::log2(p);
+                }
+            }
+            stats.top1 = size > 0 ? top1 : 0.0f;
+            stats.top2 = size > 1 ? top2 : 0.0f;
+            stats.entropy = static_cast<float>(raw_entropy);
+            return stats;
+        }
+    }
+
+    // Softmax is monotonic, so the top two logits give the top two probabilities.
+    // With m the max logit and S = sum(exp(x - m)):
+    //   p_i = exp(x_i - m) / S
+    //   H   = ln(S) - sum(exp(x_i - m) * (x_i - m)) / S   (in nats)
+    confidence_stats_t stats = {0.0f, 0.0f, 0.0f, size};
+    if (size == 0) {
+        return stats;
+    }
+    float top1 = -std::numeric_limits<float>::infinity();
+    float top2 = -std::numeric_limits<float>::infinity();
+    for (size_t i = 0; i < size; i++) {
+        const float x = scale * (static_cast<float>(output[i]) - zero_point);
+        if (x > top1) {
+            top2 = top1;
+            top1 = x;
+        } else if (x > top2) {
+            top2 = x;
+        }
+    }
+    double sum = 0.0;
+    double weighted = 0.0;
+    for (size_t i = 0; i < size; i++) {
+        const double d = scale * (static_cast<float>(output[i]) - zero_point) - top1;
+        const double e = std::exp(d);
+        sum += e;
+        if (with_entropy) {
+            weighted += e * d;
+        }
+    }
+    stats.top1 = static_cast<float>(1.0 / sum);
+    stats.top2 = size > 1 ? static_cast<float>(std::exp(static_cast<double>(top2) - top1) / sum) : 0.0f;
+    if (with_entropy) {
+        stats.entropy = static_cast<float>((std::log(sum) - weighted / sum) / std::log(2.0));
+    }
+    return stats;
+}
+
+template confidence_stats_t computeTensorConfidenceStats<float>(const float *, size_t, float, int, bool, bool);
+template confidence_stats_t computeTensorConfidenceStats<uint8_t>(const uint8_t *, size_t, float, int, bool, bool);
+
+float marginFromStats(const confidence_stats_t &stats) {
+    return 1.0f - (stats.top1 - stats.top2);
+}
+
+float leastFromStats(const confidence_stats_t &stats) {
+    if (stats.size < 2) {
+        return 0.0f;
+    }
+    return (1.0f - stats.top1) * (static_cast<float>(stats.size) / (stats.size - 1));
+}
+
+float ratioFromStats(const confidence_stats_t &stats) {
+    if (stats.top1 == 0.0f) {
+        return 0.0f;
+    }
+    return stats.top2 / stats.top1;
+}
+
+float entropyFromStats(const confidence_stats_t &stats) {
+    if (stats.size < 2) {
+        return 0.0f;
+    }
+    return stats.entropy / std::log2(static_cast<float>(stats.size));
+}
 
   /**
    * @brief Calculates margin confidence (difference between top two probabilities)
@@ -129,13 +362,11 @@ int ImageSampler::sample(std::vector<std::pair<float, int>> &results, cv::Mat &i
    * @return Margin confidence score
    */
 
-   float ImageSampler::margin_confidence(std::vector<float>& prob_dist, bool sorted = false) {
-    if (!sorted) {
-        std::sort(prob_dist.begin(), prob_dist.end(), std::greater<float>()); // Sort probabilities from largest to smallest
+   float ImageSampler::margin_confidence(const std::vector<float>& prob_dist, bool sorted = false) {
+    if (sorted && prob_dist.size() >= 2) {
+        return 1.0f - (prob_dist[0] - prob_dist[1]); // Difference between the top two probabilities
     }
-    float difference = prob_dist[0] - prob_dist[1]; // Difference between the top two probabilities
-    float margin_conf = 1.0f - difference;
-    return margin_conf;
+    return marginFromStats(computeConfidenceStats(prob_dist.data(), prob_dist.size(), false));
    }
 
    
@@ -146,51 +377,37 @@ int ImageSampler::sample(std::vector<std::pair<float, int>> &results, cv::Mat &i
    * @return least confidence score
    */
 
-    float ImageSampler::least_confidence(std::vector<float>& prob_dist, bool sorted = false) {
-    float simple_least_conf;
-    if (sorted) {
-        simple_least_conf = prob_dist[0]; // Most confident prediction
-    } else {
-        simple_least_conf = *std::max_element(prob_dist.begin(), prob_dist.end()); // Most confident prediction
+    float ImageSampler::least_confidence(const std::vector<float>& prob_dist, bool sorted = false) {
+    if (sorted && !prob_dist.empty()) {
+        confidence_stats_t stats = {prob_dist[0], 0.0f, 0.0f, prob_dist.size()}; // Most confident prediction
+        return leastFromStats(stats);
     }
-    size_t num_labels = prob_dist.size(); // Number of labels
-    float normalized_least_conf = (1.0f - simple_least_conf) * (static_cast<float>(num_labels) / (num_labels - 1));
-    return normalized_least_conf;
+    return leastFromStats(computeConfidenceStats(prob_dist.data(), prob_dist.size(), false));
     }
 
 
   /**
-   * @brief Calculates ratio confidence (difference between top two probabilities)
+   * @brief Calculates ratio confidence (ratio of top two probabilities)
    * @param prob_dist Vector of class probabilities
    * @param sorted Flag indicating if probabilities are already sorted (default: false)
-   * @return Margin confidence score
+   * @return Ratio confidence score
    */
 
-    float ImageSampler::ratio_confidence(std::vector<float>& prob_dist, bool sorted = false) {
-    if (!sorted) {
-        std::sort(prob_dist.begin(), prob_dist.end(), std::greater<float>()); // Sort probabilities from largest to smallest
+    float ImageSampler::ratio_confidence(const std::vector<float>& prob_dist, bool sorted = false) {
+    if (sorted && prob_dist.size() >= 2) {
+        confidence_stats_t stats = {prob_dist[0], prob_dist[1], 0.0f, prob_dist.size()};
+        return ratioFromStats(stats); // Ratio between the top two probabilities
     }
-    float ratio_conf = prob_dist[1] / prob_dist[0]; // Ratio between the top two probabilities
-    return ratio_conf;
+    return ratioFromStats(computeConfidenceStats(prob_dist.data(), prob_dist.size(), false));
     }
 
 
   /**
    * @brief Calculates entropy based confidence
    * @param prob_dist Vector of class probabilities
-   * @param sorted Flag indicating if probabilities are already sorted (default: false)
    * @return Entropy confidence score
    */
 
-   float ImageSampler::entropy_confidence(std::vector<float>& prob_dist) {
-    float raw_entropy = 0.0;
-    size_t num_labels = prob_dist.size();
-
-    for (size_t i = 0; i < num_labels; i++) {
-        if (prob_dist[i] > 0.0) {
-            raw_entropy -= prob_dist[i] * std::log2(prob_dist[i]); // Multiply each probability by its base 2 log and sum
-        }
-    }
-    float normalized_entropy = raw_entropy / std::log2(static_cast<float>(num_labels));
-    return normalized_entropy;
-    }
+   float ImageSampler::entropy_confidence(const std::vector<float>& prob_dist) {
+    return entropyFromStats(computeConfidenceStats(prob_dist.data(), prob_dist.size(), true));
+   }
@@ -72,6 +72,97 @@ TEST_F(ImageSamplerTest, EntropyConfidence) {
     EXPECT_GT(result, 0);  // Entropy should be greater than 0
 }
 
+// Test the single-pass kernel against hand-computed scores; the input is left untouched
+TEST_F(ImageSamplerTest, ConfidenceStatsSinglePass) {
+    std::vector<float> prob_dist = {0.2f, 0.7f, 0.1f, 0.5f};
+    const std::vector<float> original = prob_dist;
+    confidence_stats_t stats = computeConfidenceStats(prob_dist.data(), prob_dist.size(), true);
+    EXPECT_FLOAT_EQ(stats.top1, 0.7f);
+    EXPECT_FLOAT_EQ(stats.top2, 0.5f);
+    EXPECT_EQ(stats.size, 4u);
+    EXPECT_FLOAT_EQ(sampler->margin_confidence(prob_dist, false), 0.8f);       // 1 - (0.7 - 0.5)
+    EXPECT_FLOAT_EQ(sampler->ratio_confidence(prob_dist, false), 0.5f / 0.7f);
+    EXPECT_FLOAT_EQ(sampler->least_confidence(prob_dist, false), 0.4f);        // (1 - 0.7) * 4 / 3
+    EXPECT_EQ(prob_dist, original);
+
+    // Sorted input gives the same scores
+    const std::vector<float> sorted = {0.7f, 0.5f, 0.2f, 0.1f};
+    EXPECT_FLOAT_EQ(sampler->margin_confidence(sorted, true), 0.8f);
+    EXPECT_FLOAT_EQ(sampler->ratio_confidence(sorted, true), 0.5f / 0.7f);
+    EXPECT_FLOAT_EQ(sampler->least_confidence(sorted, true), 0.4f);
+}
+
+// Test ties for the top probability
+TEST_F(ImageSamplerTest, ConfidenceStatsTies) {
+    const std::vector<float> prob_dist = {0.4f, 0.2f, 0.4f};
+    confidence_stats_t stats = computeConfidenceStats(prob_dist.data(), prob_dist.size(), false);
+    EXPECT_FLOAT_EQ(stats.top1, 0.4f);
+    EXPECT_FLOAT_EQ(stats.top2, 0.4f);
+    EXPECT_FLOAT_EQ(sampler->margin_confidence(prob_dist, false), 1.0f);
+    EXPECT_FLOAT_EQ(sampler->ratio_confidence(prob_dist, false), 1.0f);
+}
+
+// Test entropy in bits, normalised by log2 of the class count; zero probabilities add nothing
+TEST_F(ImageSamplerTest, ConfidenceStatsEntropy) {
+    const std::vector<float> uniform = {0.25f, 0.25f, 0.25f, 0.25f};
+    EXPECT_FLOAT_EQ(sampler->entropy_confidence(uniform), 1.0f);
+
+    const std::vector<float> with_zero = {0.25f, 0.0f, 0.5f, 0.25f};  // 1.5 bits of 2
+    confidence_stats_t stats = computeConfidenceStats(with_zero.data(), with_zero.size(), true);
+    EXPECT_FLOAT_EQ(stats.entropy, 1.5f);
+    EXPECT_FLOAT_EQ(sampler->entropy_confidence(with_zero), 0.75f);
+
+    const std::vector<float> certain = {0.0f, 1.0f, 0.0f};
+    EXPECT_FLOAT_EQ(sampler->entropy_confidence(certain), 0.0f);
+}
+
+// Test fewer than two classes, sorted or not, never reads past the input
+TEST_F(ImageSamplerTest, ConfidenceStatsFewClasses) {
+    const std::vector<float> single = {0.9f};
+    for (bool sorted : {false, true}) {
+        EXPECT_NEAR(sampler->margin_confidence(single, sorted), 0.1f, 1e-6);  // 1 - (0.9 - 0)
+        EXPECT_FLOAT_EQ(sampler->ratio_confidence(single, sorted), 0.0f);
+        EXPECT_FLOAT_EQ(sampler->least_confidence(single, sorted), 0.0f);
+    }
+    EXPECT_FLOAT_EQ(sampler->entropy_confidence(single), 0.0f);
+
+    const std::vector<float> empty;
+    for (bool sorted : {false, true}) {
+        EXPECT_FLOAT_EQ(sampler->margin_confidence(empty, sorted), 1.0f);
+        EXPECT_FLOAT_EQ(sampler->ratio_confidence(empty, sorted), 0.0f);
+        EXPECT_FLOAT_EQ(sampler->least_confidence(empty, sorted), 0.0f);
+    }
+    EXPECT_FLOAT_EQ(sampler->entropy_confidence(empty), 0.0f);
+}
+
+// Test raw logits and quantized outputs give the same statistics as probabilities
+TEST_F(ImageSamplerTest, TensorConfidenceStats) {
+    const float logits[] = {1.0f, 3.0f, 2.0f, -1.0f};
+    std::vector<float> probs(4);
+    float sum = 0.0f;
+    for (int i = 0; i < 4; ++i) {
+        probs[i] = std::exp(logits[i]);
+        sum += probs[i];
+    }
+    for (auto &p : probs) {
+        p /= sum;
+    }
+    confidence_stats_t expected = computeConfidenceStats(probs.data(), probs.size(), true);
+    confidence_stats_t softmax = computeTensorConfidenceStats(logits, 4, 1.0f, 0, true, true);
+    EXPECT_NEAR(softmax.top1, expected.top1, 1e-5);
+    EXPECT_NEAR(softmax.top2, expected.top2, 1e-5);
+    EXPECT_NEAR(softmax.entropy, expected.entropy, 1e-4);
+
+    const uint8_t quantized[] = {128, 48, 28};  // 0.5, 0.1875, 0.109375 with scale 1/256
+    confidence_stats_t dequantized = computeTensorConfidenceStats(quantized, 3, 1.0f / 256, 0, false, false);
+    EXPECT_FLOAT_EQ(dequantized.top1, 0.5f);
+    EXPECT_FLOAT_EQ(dequantized.top2, 0.1875f);
+
+    cv::Mat img = cv::Mat::ones(10, 10, CV_8UC1);
+    EXPECT_EQ(sampler->sample(logits, 4, img, true, true), 1);
+    EXPECT_EQ(sampler->sample(quantized, 3, 1.0f / 256, 0, img, false, true), 1);
+}
+
 // Test the sample method
 TEST_F(ImageSamplerTest, SampleMethod) {
     std::vector<std::pair<float, int>> classificationResults = {
@@ -84,3 +175,73 @@ TEST_F(ImageSamplerTest, SampleMethod) {
     int result = sampler->sample(classificationResults, img, true);  // Sample with save_sample = true
     EXPECT_EQ(result, 1);  // Expected success
 }
+
+// Test the batched sample methods update every metric sketch once per image,
+// with the same scores and samples as per-image sample() calls
+TEST_F(ImageSamplerTest, SampleBatchMethod) {
+    std::vector<cv::Mat> imgs(2, cv::Mat::ones(10, 10, CV_8UC1));
+    const float probs[6] = {0.7f, 0.2f, 0.1f,
+                            0.4f, 0.35f, 0.25f};
+    const uint8_t quantized[6] = {200, 40, 16,
+                                  100, 90, 66};
+    std::vector<std::vector<std::pair<float, int>>> results = {
+        {{0.7f, 1}, {0.2f, 2}, {0.1f, 3}},
+        {{0.4f, 1}, {0.35f, 2}, {0.25f, 3}},
+    };
+    ImageSampler single("test_config.ini", 1);
+    ASSERT_EQ(sampler->metricPlan.size(), 4u);
+    ASSERT_EQ(single.metricPlan.size(), sampler->metricPlan.size());
+
+    // Every metric sketch has batch x calls items, with the same scores on both samplers
+    auto expectSameSketches = [&](uint64_t calls) {
+        for (size_t m = 0; m < sampler->metricPlan.size(); m++) {
+            const distributionBox batched = sampler->metricPlan[m].box->snapshot();
+            const distributionBox expected = single.metricPlan[m].box->snapshot();
+            SCOPED_TRACE(sampler->metricPlan[m].name);
+            ASSERT_EQ(batched.get_n(), imgs.size() * calls);
+            ASSERT_EQ(expected.get_n(), batched.get_n());
+            EXPECT_FLOAT_EQ(batched.get_min_item(), expected.get_min_item());
+            EXPECT_FLOAT_EQ(batched.get_max_item(), expected.get_max_item());
+        }
+    };
+
+    EXPECT_EQ(sampler->sampleBatch(probs, 3, imgs, false, true), 1);
+    for (size_t i = 0; i < imgs.size(); i++) {
+        EXPECT_EQ(single.sample(probs + 3 * i, 3, imgs[i], false, true), 1);
+    }
+    expectSameSketches(1);
+
+    EXPECT_EQ(sampler->sampleBatch(quantized, 3, 1.0f / 256, 0, imgs, false, true), 1);
+    for (size_t i = 0; i < imgs.size(); i++) {
+        EXPECT_EQ(single.sample(quantized + 3 * i, 3, 1.0f / 256, 0, imgs[i], false, true), 1);
+    }
+    expectSameSketches(2);
+
+    EXPECT_EQ(sampler->sampleBatch(results, imgs, true), 1);
+    for (size_t i = 0; i < imgs.size(); i++) {
+        EXPECT_EQ(single.sample(results[i], imgs[i], true), 1);
+    }
+    expectSameSketches(3);
+
+    results.pop_back();
+    EXPECT_EQ(sampler->sampleBatch(results, imgs, true), -1);  // One result per image is required
+    expectSameSketches(3);
+
+    // Both selected the same frames
+    sampler->sampleWriter->stop();
+    single.sampleWriter->stop();
+    EXPECT_EQ(sampler->sampleWriter->getWrittenCount() + sampler->sampleWriter->getFailedCount(),
+              single.sampleWriter->getWrittenCount() + single.sampleWriter->getFailedCount());
+    EXPECT_EQ(sampler->sampleWriter->getDroppedCount(), single.sampleWriter->getDroppedCount());
+}
+
+// Test an invalid threshold is rejected when the sampler is constructed
+TEST_F(ImageSamplerTest, InvalidThresholdThrows) {
+    std::ofstream ini_file("bad_config.ini", std::ios::trunc);
+    ini_file << "[sampling]\n";
+    ini_file << "filepath = ./\n";
+    ini_file << "MARGINCONFIDENCE = high\n";
+    ini_file.close();
+    EXPECT_THROW(ImageSampler("bad_config.ini", 1), std::invalid_argument);
+    std::remove("bad_config.ini");
+}
@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <kll_sketch.hpp>
+
+typedef datasketches::kll_sketch<float> kll_float_sketch;
+
+// Fraction of the items that are <= value, what get_rank() estimates
+static double exactRank(std::vector<float> sorted, float value) {
+    std::sort(sorted.begin(), sorted.end());
+    return static_cast<double>(std::upper_bound(sorted.begin(), sorted.end(), value) - sorted.begin()) /
+           sorted.size();
+}
+
+// Both sketches describe the same stream: same n, min, max and ranks within the error bound
+static void expectSameStream(const kll_float_sketch& actual, const kll_float_sketch& expected,
+                             const std::vector<float>& stream) {
+    ASSERT_EQ(actual.get_n(), expected.get_n());
+    ASSERT_EQ(actual.get_n(), stream.size());
+    EXPECT_EQ(actual.get_min_item(), expected.get_min_item());
+    EXPECT_EQ(actual.get_max_item(), expected.get_max_item());
+    const double eps = actual.get_normalized_rank_error(false);
+    for (float value : {0.0f, 10.0f, 100.0f, 250.0f, 500.0f, 750.0f, 999.0f}) {
+        const double rank = exactRank(stream, value);
+        EXPECT_NEAR(actual.get_rank(value), rank, eps) << "value " << value;
+        EXPECT_NEAR(expected.get_rank(value), rank, eps) << "value " << value;
+    }
+}
+
+TEST(KllSketchTest, BatchUpdateMatchesRepeatedUpdate) {
+    std::vector<float> items;
+    for (int i = 0; i < 5000; i++) {
+        items.push_back(static_cast<float>((i * 7919) % 1000));
+    }
+    kll_float_sketch single;
+    for (float item : items) {
+        single.update(item);
+    }
+    kll_float_sketch batch;
+    // Uneven chunks so batches straddle level zero compactions
+    for (size_t offset = 0; offset < items.size(); offset += 333) {
+        batch.update(items.data() + offset, std::min<size_t>(333, items.size() - offset));
+    }
+    expectSameStream(batch, single, items);
+}
+
+TEST(KllSketchTest, BatchUpdateSkipsNaN) {
+    const float items[] = {3.0f, std::numeric_limits<float>::quiet_NaN(), 1.0f, 2.0f};
+    kll_float_sketch sketch;
+    sketch.update(items, 4);
+    EXPECT_EQ(sketch.get_n(), 3u);
+    EXPECT_EQ(sketch.get_min_item(), 1.0f);
+    EXPECT_EQ(sketch.get_max_item(), 3.0f);
+}
+
+TEST(KllSketchTest, SmallWeightMatchesRepeatedUpdate) {
+    kll_float_sketch weighted;
+    kll_float_sketch single;
+    std::vector<float> stream;
+    // Weights below the free space of level zero take the direct copy path
+    for (int i = 0; i < 1000; i++) {
+        const float value = static_cast<float>((i * 37) % 1000);
+        const uint64_t weight = 1 + i % 5;
+        weighted.update(value, weight);
+        for (uint64_t w = 0; w < weight; w++) {
+            single.update(value);
+            stream.push_back(value);
+        }
+    }
+    expectSameStream(weighted, single, stream);
+}
+
+TEST(KllSketchTest, LargeWeightMatchesRepeatedUpdate) {
+    kll_float_sketch weighted;
+    kll_float_sketch single;
+    std::vector<float> stream;
+    // Weights above the free space of level zero go through the power-of-two merge
+    for (int i = 0; i < 100; i++) {
+        const float value = static_cast<float>((i * 101) % 1000);
+        const uint64_t weight = 300 + 17 * i;
+        weighted.update(value, weight);
+        for (uint64_t w = 0; w < weight; w++) {
+            single.update(value);
+            stream.push_back(value);
+        }
+    }
+    expectSameStream(weighted, single, stream);
+}
+
+TEST(KllSketchTest, WeightZeroIsIgnored) {
+    kll_float_sketch sketch;
+    sketch.update(5.0f, 0);
+    EXPECT_TRUE(sketch.is_empty());
+    sketch.update(5.0f, 1);
+    EXPECT_EQ(sketch.get_n(), 1u);
+}